@@ -20,6 +20,14 @@ typedef int BOOL;
 
 #define MAX_DOF 3
 #define MAX_MATERIAL_PARAMETERS 10
+/* maximum number of nodes per element */
+#define MAX_ELEMENT_NODES 10
+/* maximum number of gauss nodes per element */
+#define MAX_GAUSS_NODES 5
+/* maximum size of the local stiffness matrix */
+#define MAX_ELEMENT_DOF (MAX_ELEMENT_NODES*MAX_DOF)
+/* alignment of the arrays of per gauss node data, in bytes */
+#define MEMORY_ALIGNMENT 64
 
 /* define specific macros used by GCC compiler */
 #ifdef __GNUC__
@@ -34,6 +42,18 @@ typedef int BOOL;
 #define UNUSED
 #endif /* __GNUC__ */
 
+/*
+ * Compile the function for AVX-512, AVX2 and generic x86-64 and
+ * select one of them at runtime depending on the CPU.
+ * Use BEFORE function definition
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 && \
+  defined(__x86_64__) && defined(__linux__)
+#define TARGET_CLONES __attribute__ ((target_clones("avx512f","avx2","default")))
+#else
+#define TARGET_CLONES
+#endif
+
 /* Redefine type of the floating point values */
 #ifdef SINGLE
 typedef float real;
@@ -0,0 +1,152 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#include <string.h>
+#include <math.h>
+#include "element_batch.h"
+
+/* loop by lanes of the batch, shall be vectorized */
+#ifdef _OPENMP
+#define FOR_LANES(l) _Pragma("omp simd")                \
+  for (l = 0; l < ELEMENT_BATCH_SIZE; ++ l)
+#else
+#define FOR_LANES(l) for (l = 0; l < ELEMENT_BATCH_SIZE; ++ l)
+#endif
+
+/*
+ * Fill all lanes of the batch with elements. Unused lanes of the
+ * short batch repeat the last element, so all lanes contain valid
+ * data, but results of these lanes are never stored
+ */
+static void element_batch_fill(int* elements, int count, int* batch)
+{
+  int l;
+  for (l = 0; l < ELEMENT_BATCH_SIZE; ++ l)
+    batch[l] = elements[l < count ? l : count - 1];
+}
+
+/*
+ * Inverse of the 3x3 matrices in lanes of m, in place.
+ * Determinants are stored in det; lanes with zero determinant
+ * contain no valid results
+ */
+TARGET_CLONES
+static void element_batch_inv3x3(real m[MAX_DOF][MAX_DOF][ELEMENT_BATCH_SIZE],
+                                 real* det)
+{
+  int l;
+  real m00,m01,m02,m10,m11,m12,m20,m21,m22,d;
+  FOR_LANES(l)
+  {
+    m00 = m[1][1][l]*m[2][2][l]-m[1][2][l]*m[2][1][l];
+    m01 = m[0][2][l]*m[2][1][l]-m[0][1][l]*m[2][2][l];
+    m02 = m[0][1][l]*m[1][2][l]-m[0][2][l]*m[1][1][l];
+    m10 = m[1][2][l]*m[2][0][l]-m[1][0][l]*m[2][2][l];
+    m11 = m[0][0][l]*m[2][2][l]-m[0][2][l]*m[2][0][l];
+    m12 = m[0][2][l]*m[1][0][l]-m[0][0][l]*m[1][2][l];
+    m20 = m[1][0][l]*m[2][1][l]-m[1][1][l]*m[2][0][l];
+    m21 = m[0][1][l]*m[2][0][l]-m[0][0][l]*m[2][1][l];
+    m22 = m[0][0][l]*m[1][1][l]-m[0][1][l]*m[1][0][l];
+    det[l] = m[0][0][l]*m00 + m[0][1][l]*m10 + m[0][2][l]*m20;
+    d = 1/det[l];
+    m[0][0][l] = m00*d; m[0][1][l] = m01*d; m[0][2][l] = m02*d;
+    m[1][0][l] = m10*d; m[1][1][l] = m11*d; m[1][2][l] = m12*d;
+    m[2][0][l] = m20*d; m[2][1][l] = m21*d; m[2][2][l] = m22*d;
+  }
+}
+
+/*
+ * Derivatives of the TETRAHEDRA10 shape functions in the point (r,s,t),
+ * [dof x nodes], see tetrahedra10_disoform
+ */
+#define TETRAHEDRA10_DFORMS(r,s,t)                                      \
+  {{4*(t)+4*(s)+4*(r)-3, 4*(r)-1, 0, 0, -4*(t)-4*(s)-8*(r)+4,           \
+    4*(s), -4*(s), -4*(t), 4*(t), 0},                                   \
+   {4*(t)+4*(s)+4*(r)-3, 0, 4*(s)-1, 0, -4*(r),                         \
+    4*(r), -4*(t)-8*(s)-4*(r)+4, -4*(t), 0, 4*(t)},                     \
+   {4*(t)+4*(s)+4*(r)-3, 0, 0, 4*(t)-1, -4*(r),                         \
+    0, -4*(s), -8*(t)-4*(s)-4*(r)+4, 4*(r), 4*(s)}}
+
+/* TETRAHEDRA10 with 4 gauss nodes, see gauss_nodes4_tetr10 */
+static const real tetrahedra10_gauss4_weights[4] =
+{(1/4.)/6., (1/4.)/6., (1/4.)/6., (1/4.)/6.};
+static const real tetrahedra10_gauss4_dforms[4][MAX_DOF][10] = {
+  TETRAHEDRA10_DFORMS(TETRAHEDRA10_GAUSS4_A,TETRAHEDRA10_GAUSS4_B,
+                      TETRAHEDRA10_GAUSS4_B),
+  TETRAHEDRA10_DFORMS(TETRAHEDRA10_GAUSS4_B,TETRAHEDRA10_GAUSS4_A,
+                      TETRAHEDRA10_GAUSS4_B),
+  TETRAHEDRA10_DFORMS(TETRAHEDRA10_GAUSS4_B,TETRAHEDRA10_GAUSS4_B,
+                      TETRAHEDRA10_GAUSS4_A),
+  TETRAHEDRA10_DFORMS(TETRAHEDRA10_GAUSS4_B,TETRAHEDRA10_GAUSS4_B,
+                      TETRAHEDRA10_GAUSS4_B)};
+
+/* TETRAHEDRA10 with 5 gauss nodes, see gauss_nodes5_tetr10 */
+static const real tetrahedra10_gauss5_weights[5] =
+{(-4/5.)/6., (9/20.)/6., (9/20.)/6., (9/20.)/6., (9/20.)/6.};
+static const real tetrahedra10_gauss5_dforms[5][MAX_DOF][10] = {
+  TETRAHEDRA10_DFORMS(1/4.,1/4.,1/4.),
+  TETRAHEDRA10_DFORMS(1/2.,1/6.,1/6.),
+  TETRAHEDRA10_DFORMS(1/6.,1/2.,1/6.),
+  TETRAHEDRA10_DFORMS(1/6.,1/6.,1/2.),
+  TETRAHEDRA10_DFORMS(1/6.,1/6.,1/6.)};
+
+/* generic kernels, sizes and gauss nodes from the solver */
+#define KERNEL_NAME(name) name
+#define KERNEL_STORAGE
+#define KERNEL_NODES self->fea_params_p->nodes_per_element
+#define KERNEL_DOF self->task_p->dof
+#define KERNEL_GAUSS self->fea_params_p->gauss_nodes_count
+#define KERNEL_DFORMS(gauss) self->elements_db.gauss_nodes[gauss]->dforms
+#define KERNEL_WEIGHT(gauss) self->elements_db.gauss_nodes[gauss]->weight
+#include "element_batch_kernels.h"
+#undef KERNEL_NAME
+#undef KERNEL_STORAGE
+#undef KERNEL_NODES
+#undef KERNEL_DOF
+#undef KERNEL_GAUSS
+#undef KERNEL_DFORMS
+#undef KERNEL_WEIGHT
+
+/* TETRAHEDRA10 with 4 gauss nodes */
+#define KERNEL_NAME(name) name##_tetrahedra10_4
+#define KERNEL_STORAGE static
+#define KERNEL_NODES 10
+#define KERNEL_DOF MAX_DOF
+#define KERNEL_GAUSS 4
+#define KERNEL_DFORMS(gauss) tetrahedra10_gauss4_dforms[gauss]
+#define KERNEL_WEIGHT(gauss) tetrahedra10_gauss4_weights[gauss]
+#include "element_batch_kernels.h"
+#undef KERNEL_NAME
+#undef KERNEL_GAUSS
+#undef KERNEL_DFORMS
+#undef KERNEL_WEIGHT
+
+/* TETRAHEDRA10 with 5 gauss nodes */
+#define KERNEL_NAME(name) name##_tetrahedra10_5
+#define KERNEL_GAUSS 5
+#define KERNEL_DFORMS(gauss) tetrahedra10_gauss5_dforms[gauss]
+#define KERNEL_WEIGHT(gauss) tetrahedra10_gauss5_weights[gauss]
+#include "element_batch_kernels.h"
+#undef KERNEL_NAME
+#undef KERNEL_STORAGE
+#undef KERNEL_NODES
+#undef KERNEL_DOF
+#undef KERNEL_GAUSS
+#undef KERNEL_DFORMS
+#undef KERNEL_WEIGHT
+
+const batch_kernels batch_kernels_generic = {
+  element_batch_shape_gradients,
+  element_batch_stresses_and_residual_forces,
+  element_batch_stiffness
+};
+
+const batch_kernels batch_kernels_tetrahedra10_4 = {
+  element_batch_shape_gradients_tetrahedra10_4,
+  element_batch_stresses_and_residual_forces_tetrahedra10_4,
+  element_batch_stiffness_tetrahedra10_4
+};
+
+const batch_kernels batch_kernels_tetrahedra10_5 = {
+  element_batch_shape_gradients_tetrahedra10_5,
+  element_batch_stresses_and_residual_forces_tetrahedra10_5,
+  element_batch_stiffness_tetrahedra10_5
+};
@@ -0,0 +1,75 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#ifndef __ELEMENT_BATCH_H__
+#define __ELEMENT_BATCH_H__
+
+#include "defines.h"
+#include "fea_solver.h"
+
+/*
+ * Element-batched kernels.
+ * Groups of up to ELEMENT_BATCH_SIZE elements are processed in
+ * lockstep: all per element values are stored in arrays with the
+ * last index by element in the batch (lane), and the innermost loops
+ * are by lanes, so they are vectorized with the full width of
+ * AVX2/AVX-512 registers regardless of the number of nodes, d.o.f.
+ * and gauss nodes of the element.
+ * The kernels are compiled for several instruction sets and the
+ * best one is selected at runtime, see TARGET_CLONES in defines.h
+ * Batches could be shorter than ELEMENT_BATCH_SIZE: count elements
+ * are processed from the array elements
+ */
+
+/* number of elements processed together, 8 doubles in AVX-512 */
+#define ELEMENT_BATCH_SIZE 8
+
+/*
+ * Generic kernels, with the number of nodes, d.o.f. and gauss
+ * nodes of the solver
+ */
+
+/*
+ * Calculate gradients of shape functions and determinants of Jacobi
+ * matrices in gauss nodes of the elements, in configuration defined
+ * by nodes. Results are stored in grads and detJ arrays with the
+ * layouts of solver shape_gradients and detJ arrays.
+ * Previous values are kept if the Jacobi matrix is singular
+ */
+void element_batch_shape_gradients(fea_solver_ptr self,
+                                   nodes_array_ptr nodes,
+                                   real* grads,
+                                   real* detJ,
+                                   int* elements,
+                                   int count);
+
+/*
+ * Calculate deformation gradients and stresses in gauss nodes of the
+ * elements and add residual forces of the elements to the global
+ * residual forces vector. Elements shall not share nodes
+ * Stresses are calculated by the material model for every element
+ */
+void element_batch_stresses_and_residual_forces(fea_solver_ptr self,
+                                                int* elements,
+                                                int count);
+
+/*
+ * Calculate local stiffness matrices of the elements and add them
+ * to the global stiffness matrix. Elements shall not share nodes
+ * Only models with isotropic tangent (model.tangent) are supported
+ */
+void element_batch_stiffness(fea_solver_ptr self,
+                             int* elements,
+                             int count);
+
+/*
+ * Kernel sets: generic, for any element type and number of gauss
+ * nodes, and specialized for TETRAHEDRA10 with 4 and 5 gauss nodes.
+ * In specialized kernels the numbers of nodes, d.o.f. and gauss
+ * nodes, and the derivatives of the shape functions in gauss nodes
+ * are compile-time constants. Kernels are selected by
+ * solver_create_element_params
+ */
+extern const batch_kernels batch_kernels_generic;
+extern const batch_kernels batch_kernels_tetrahedra10_4;
+extern const batch_kernels batch_kernels_tetrahedra10_5;
+
+#endif /* __ELEMENT_BATCH_H__ */
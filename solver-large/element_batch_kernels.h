@@ -0,0 +1,332 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/*
+ * Template of the element-batched kernels, included by element_batch.c
+ * several times, therefore there is no include guard.
+ * The following macros shall be defined before the inclusion:
+ * KERNEL_NAME(name) - name of the kernel function
+ * KERNEL_STORAGE - storage class of the kernel functions
+ * KERNEL_NODES - number of nodes per element
+ * KERNEL_DOF - number of d.o.f.
+ * KERNEL_GAUSS - number of gauss nodes
+ * KERNEL_DFORMS(gauss) - [dof x nodes] table of derivatives of the
+ * shape functions in the gauss node
+ * KERNEL_WEIGHT(gauss) - weight of the gauss node
+ * For the specialized kernels all of them are compile-time constants,
+ * so all loops have constant trip counts
+ */
+
+/*
+ * Gather gradients of shape functions in current configuration
+ * in the gauss node of elements of the batch, and the integration
+ * factors: det(J) multiplied by the weight of the gauss node,
+ * or 0 if gradients in the gauss node are not available
+ */
+static void KERNEL_NAME(element_batch_gather_grads)(fea_solver_ptr self,
+                                                    int* batch,
+                                                    int gauss,
+                                                    real g[MAX_DOF]
+                                                    [MAX_ELEMENT_NODES]
+                                                    [ELEMENT_BATCH_SIZE],
+                                                    real* factor)
+{
+  int a,k,l,index;
+  real* grads;
+  int nelem = KERNEL_NODES;
+  real weight = KERNEL_WEIGHT(gauss);
+  for (l = 0; l < ELEMENT_BATCH_SIZE; ++ l)
+  {
+    index = solver_gauss_index(self,batch[l],gauss);
+    grads = solver_element_gauss_grads(self,TRUE,batch[l],gauss);
+    for (k = 0; k < MAX_DOF; ++ k)
+      for (a = 0; a < nelem; ++ a)
+        g[k][a][l] = grads[k*nelem + a];
+    factor[l] = fabs(self->detJ[index])*weight;
+  }
+}
+
+TARGET_CLONES
+KERNEL_STORAGE
+void KERNEL_NAME(element_batch_shape_gradients)(fea_solver_ptr self,
+                                                nodes_array_ptr nodes,
+                                                real* grads,
+                                                real* detJ,
+                                                int* elements,
+                                                int count)
+{
+  int batch[ELEMENT_BATCH_SIZE];
+  /* nodal coordinates x[node][dof][lane] */
+  real x[MAX_ELEMENT_NODES][MAX_DOF][ELEMENT_BATCH_SIZE];
+  /* Jacobi matrices and their inverses */
+  real J[MAX_DOF][MAX_DOF][ELEMENT_BATCH_SIZE];
+  real det[ELEMENT_BATCH_SIZE];
+  real g[MAX_DOF][MAX_ELEMENT_NODES][ELEMENT_BATCH_SIZE];
+  real* dst;
+  int gauss,i,j,k,l,index;
+  int nelem = KERNEL_NODES;
+  int size = KERNEL_DOF*nelem;
+
+  element_batch_fill(elements,count,batch);
+  for (k = 0; k < nelem; ++ k)
+    for (j = 0; j < MAX_DOF; ++ j)
+      for (l = 0; l < ELEMENT_BATCH_SIZE; ++ l)
+        x[k][j][l] = nodes->nodes[self->elements_p->elements[batch[l]][k]][j];
+
+  for (gauss = 0; gauss < KERNEL_GAUSS; ++ gauss)
+  {
+    /* Jacobi matrix, Bonet & Wood 7.6(a,b) p.198, 1st edition */
+    for (i = 0; i < MAX_DOF; ++ i)
+      for (j = 0; j < MAX_DOF; ++ j)
+      {
+        FOR_LANES(l)
+          J[i][j][l] = 0;
+        for (k = 0; k < nelem; ++ k)
+          FOR_LANES(l)
+            J[i][j][l] += KERNEL_DFORMS(gauss)[i][k]*x[k][j][l];
+      }
+    element_batch_inv3x3(J,det);
+    /* [dN/dx dN/dy dN/dz]' = J^-1 * [dN/dr dN/ds dN/dt]' */
+    for (i = 0; i < MAX_DOF; ++ i)
+      for (j = 0; j < nelem; ++ j)
+      {
+        FOR_LANES(l)
+          g[i][j][l] = 0;
+        for (k = 0; k < MAX_DOF; ++ k)
+          FOR_LANES(l)
+            g[i][j][l] += J[i][k][l]*KERNEL_DFORMS(gauss)[k][j];
+      }
+    /* store results */
+    for (l = 0; l < count; ++ l)
+    {
+      if (det[l] == 0)
+        continue;
+      index = solver_gauss_index(self,batch[l],gauss);
+      detJ[index] = det[l];
+      dst = grads + index*size;
+      for (i = 0; i < MAX_DOF; ++ i)
+        for (j = 0; j < nelem; ++ j)
+          dst[i*nelem + j] = g[i][j][l];
+    }
+  }
+}
+
+TARGET_CLONES
+KERNEL_STORAGE void
+KERNEL_NAME(element_batch_stresses_and_residual_forces)(fea_solver_ptr self,
+                                                        int* elements,
+                                                        int count)
+{
+  int batch[ELEMENT_BATCH_SIZE];
+  /* nodal coordinates x[node][dof][lane] */
+  real x[MAX_ELEMENT_NODES][MAX_DOF][ELEMENT_BATCH_SIZE];
+  /* gradients of shape functions g[dof][node][lane] */
+  real g[MAX_DOF][MAX_ELEMENT_NODES][ELEMENT_BATCH_SIZE];
+  real F[MAX_DOF][MAX_DOF][ELEMENT_BATCH_SIZE];
+  real S[MAX_DOF][MAX_DOF][ELEMENT_BATCH_SIZE];
+  real forces[MAX_ELEMENT_NODES][MAX_DOF][ELEMENT_BATCH_SIZE];
+  real factor[ELEMENT_BATCH_SIZE];
+  real sum[ELEMENT_BATCH_SIZE];
+  real (*graddef)[MAX_DOF];
+  real (*stress)[MAX_DOF];
+  int gauss,a,i,j,k,l,index,node;
+  int nelem = KERNEL_NODES;
+  int dof = KERNEL_DOF;
+  fea_model_ptr model = &self->task_p->model;
+#ifdef CURRENT_SHAPE_GRADIENTS
+  /* F^-1 is calculated from the initial coordinates */
+  nodes_array_ptr nodes = self->nodes0_p;
+  real det[ELEMENT_BATCH_SIZE];
+#else
+  nodes_array_ptr nodes = self->nodes_p;
+  real* grads0;
+#endif
+
+  element_batch_fill(elements,count,batch);
+  for (k = 0; k < nelem; ++ k)
+    for (j = 0; j < MAX_DOF; ++ j)
+      for (l = 0; l < ELEMENT_BATCH_SIZE; ++ l)
+        x[k][j][l] = nodes->nodes[self->elements_p->elements[batch[l]][k]][j];
+  for (a = 0; a < nelem; ++ a)
+    for (i = 0; i < MAX_DOF; ++ i)
+      FOR_LANES(l)
+        forces[a][i][l] = 0;
+
+  for (gauss = 0; gauss < KERNEL_GAUSS; ++ gauss)
+  {
+    KERNEL_NAME(element_batch_gather_grads)(self,batch,gauss,g,factor);
+#ifdef CURRENT_SHAPE_GRADIENTS
+    /* F^-1 = sum x_{k,i} dN_k/dx_j, see solver_element_gauss_graddef */
+    for (i = 0; i < MAX_DOF; ++ i)
+      for (j = 0; j < MAX_DOF; ++ j)
+      {
+        FOR_LANES(l)
+          F[i][j][l] = 0;
+        for (k = 0; k < nelem; ++ k)
+          FOR_LANES(l)
+            F[i][j][l] += g[j][k][l]*x[k][i][l];
+      }
+    element_batch_inv3x3(F,det);
+#else
+    /* F = sum x_{k,i} dN_k/dX_j */
+    for (l = 0; l < ELEMENT_BATCH_SIZE; ++ l)
+    {
+      grads0 = solver_element_gauss_grads(self,FALSE,batch[l],gauss);
+      for (i = 0; i < MAX_DOF; ++ i)
+        for (j = 0; j < MAX_DOF; ++ j)
+        {
+          F[i][j][l] = 0;
+          for (k = 0; k < nelem; ++ k)
+            F[i][j][l] += grads0[j*nelem + k]*x[k][i][l];
+        }
+    }
+#endif
+    /* stresses by the material model */
+    for (l = 0; l < ELEMENT_BATCH_SIZE; ++ l)
+    {
+      if (l >= count)
+      {
+        for (i = 0; i < MAX_DOF; ++ i)
+          for (j = 0; j < MAX_DOF; ++ j)
+            S[i][j][l] = 0;
+        continue;
+      }
+      index = solver_gauss_index(self,batch[l],gauss);
+      graddef = self->graddefs[index].components;
+      stress = self->stresses[index].components;
+      for (i = 0; i < MAX_DOF; ++ i)
+        for (j = 0; j < MAX_DOF; ++ j)
+          graddef[i][j] = F[i][j][l];
+      model->stress(model,graddef,stress);
+      for (i = 0; i < MAX_DOF; ++ i)
+        for (j = 0; j < MAX_DOF; ++ j)
+          S[i][j][l] = stress[i][j];
+    }
+    /* residual forces, Bonet & Wood, 1st edition, 7.15 */
+    for (a = 0; a < nelem; ++ a)
+      for (i = 0; i < dof; ++ i)
+      {
+        FOR_LANES(l)
+          sum[l] = 0;
+        for (j = 0; j < dof; ++ j)
+          FOR_LANES(l)
+            sum[l] += S[i][j][l]*g[j][a][l];
+        FOR_LANES(l)
+          forces[a][i][l] -= sum[l]*factor[l];
+      }
+  }
+  /* distribute to the global residual forces vector */
+  for (l = 0; l < count; ++ l)
+    for (a = 0; a < nelem; ++ a)
+    {
+      node = self->elements_p->elements[batch[l]][a];
+      for (i = 0; i < dof; ++ i)
+        self->global_forces_vct[solver_global_dof(self,node,i)] +=
+          forces[a][i][l];
+    }
+}
+
+TARGET_CLONES
+KERNEL_STORAGE
+void KERNEL_NAME(element_batch_stiffness)(fea_solver_ptr self,
+                                          int* elements,
+                                          int count)
+{
+  int batch[ELEMENT_BATCH_SIZE];
+  /* local stiffness matrices of the elements of the batch */
+  real stiff[ELEMENT_BATCH_SIZE][MAX_ELEMENT_DOF][MAX_ELEMENT_DOF];
+  /* gradients of shape functions in all gauss nodes */
+  real g[MAX_GAUSS_NODES][MAX_DOF][MAX_ELEMENT_NODES][ELEMENT_BATCH_SIZE];
+  /*
+   * stresses and lambda, mu of the isotropic C tensor in all gauss
+   * nodes, multiplied by det(J) and weight of the gauss node
+   */
+  real S[MAX_GAUSS_NODES][MAX_DOF][MAX_DOF][ELEMENT_BATCH_SIZE];
+  real lambda[MAX_GAUSS_NODES][ELEMENT_BATCH_SIZE];
+  real mu[MAX_GAUSS_NODES][ELEMENT_BATCH_SIZE];
+  real factor[ELEMENT_BATCH_SIZE];
+  /* sigma*g^a in all gauss nodes */
+  real sg[MAX_GAUSS_NODES][MAX_DOF][ELEMENT_BATCH_SIZE];
+  /* block [K_{ab}] of the local stiffness matrices */
+  real kab[MAX_DOF][MAX_DOF][ELEMENT_BATCH_SIZE];
+  /* initial stress component and g^a.g^b */
+  real initial[ELEMENT_BATCH_SIZE], gab[ELEMENT_BATCH_SIZE];
+  int gauss,a,b,i,j,k,l,index;
+  int nelem = KERNEL_NODES;
+  int dof = KERNEL_DOF;
+  fea_model_ptr model = &self->task_p->model;
+
+  element_batch_fill(elements,count,batch);
+  for (gauss = 0; gauss < KERNEL_GAUSS; ++ gauss)
+  {
+    KERNEL_NAME(element_batch_gather_grads)(self,batch,gauss,g[gauss],factor);
+    for (l = 0; l < ELEMENT_BATCH_SIZE; ++ l)
+    {
+      index = solver_gauss_index(self,batch[l],gauss);
+      model->tangent(model,self->graddefs[index].components,
+                     &lambda[gauss][l],&mu[gauss][l]);
+      lambda[gauss][l] *= factor[l];
+      mu[gauss][l] *= factor[l];
+      for (i = 0; i < MAX_DOF; ++ i)
+        for (j = 0; j < MAX_DOF; ++ j)
+          S[gauss][i][j][l] =
+            self->stresses[index].components[i][j]*factor[l];
+    }
+  }
+  /*
+   * Bonet & Wood 7.35 p.207, 1st edition, upper blocks only.
+   * Every block is integrated by all gauss nodes at once, so
+   * the local stiffness matrices are written only once
+   */
+  for (a = 0; a < nelem; ++ a)
+  {
+    for (gauss = 0; gauss < KERNEL_GAUSS; ++ gauss)
+      for (k = 0; k < dof; ++ k)
+      {
+        FOR_LANES(l)
+          sg[gauss][k][l] = 0;
+        for (j = 0; j < dof; ++ j)
+          FOR_LANES(l)
+            sg[gauss][k][l] += S[gauss][j][k][l]*g[gauss][j][a][l];
+      }
+    for (b = a; b < nelem; ++ b)
+    {
+      for (i = 0; i < dof; ++ i)
+        for (j = 0; j < dof; ++ j)
+          FOR_LANES(l)
+            kab[i][j][l] = 0;
+      for (gauss = 0; gauss < KERNEL_GAUSS; ++ gauss)
+      {
+        FOR_LANES(l)
+        {
+          initial[l] = 0;
+          gab[l] = 0;
+        }
+        for (k = 0; k < dof; ++ k)
+          FOR_LANES(l)
+          {
+            initial[l] += sg[gauss][k][l]*g[gauss][k][b][l];
+            gab[l] += g[gauss][k][a][l]*g[gauss][k][b][l];
+          }
+        for (i = 0; i < dof; ++ i)
+          for (j = 0; j < dof; ++ j)
+            FOR_LANES(l)
+              kab[i][j][l] +=
+                lambda[gauss][l]*g[gauss][i][a][l]*g[gauss][j][b][l] +
+                mu[gauss][l]*g[gauss][j][a][l]*g[gauss][i][b][l];
+        for (i = 0; i < dof; ++ i)
+          FOR_LANES(l)
+            kab[i][i][l] += mu[gauss][l]*gab[l] + initial[l];
+      }
+      for (l = 0; l < count; ++ l)
+        for (i = 0; i < dof; ++ i)
+          for (j = 0; j < dof; ++ j)
+          {
+            stiff[l][a*dof + i][b*dof + j] = kab[i][j][l];
+            if (b > a)
+              stiff[l][b*dof + j][a*dof + i] = kab[i][j][l];
+          }
+    }
+  }
+  /* scatter stiffness matrices of the elements */
+  for (l = 0; l < count; ++ l)
+    solver_local_stiffness_scatter(self,batch[l],stiff[l]);
+}
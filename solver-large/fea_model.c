@@ -11,10 +11,12 @@ void fea_model_init(fea_model_ptr self, model_type type)
   case MODEL_A5:
     self->stress = fea_model_stress_A5;
     self->ctensor = fea_model_ctensor_A5;
+    self->tangent = fea_model_tangent_A5;
     break;
   case MODEL_COMPRESSIBLE_NEOHOOKEAN:
     self->stress = fea_model_stress_compr_neohookean;
     self->ctensor = fea_model_ctensor_compr_neohookean;
+    self->tangent = fea_model_tangent_compr_neohookean;
     break;
   default:
     assert(FALSE);
@@ -146,3 +148,60 @@ void fea_model_ctensor_compr_neohookean(fea_model_ptr self,
             + 2*mu1 * DELTA (i, k) * DELTA (j, l);
   
 }
+
+void fea_model_tangent_A5(fea_model_ptr self,
+                          real (*graddef)[MAX_DOF],
+                          real* lambda,
+                          real* mu)
+{
+  real detF = det3x3(graddef);
+  *lambda = self->parameters[0]/detF;
+  *mu = self->parameters[1]/detF;
+}
+
+void fea_model_tangent_compr_neohookean(fea_model_ptr self,
+                                        real (*graddef)[MAX_DOF],
+                                        real* lambda,
+                                        real* mu)
+{
+  real J = det3x3(graddef);
+  /*
+   * lambda/J*d_ij*d_kl + 2*mu1*d_ik*d_jl after symmetrization
+   * by minor indexes turns into mu1*(d_ik*d_jl + d_il*d_jk)
+   */
+  *lambda = self->parameters[0]/J;
+  *mu = (self->parameters[1] - self->parameters[0]*log(J))/J;
+}
+
+void fea_model_voigt_tangent(fea_model_ptr self,
+                             real (*graddef)[MAX_DOF],
+                             real (*voigt)[VOIGT_SIZE])
+{
+  /* Voigt index -> tensor indexes */
+  static const int voigt_i[VOIGT_SIZE] = {0, 1, 2, 0, 1, 0};
+  static const int voigt_j[VOIGT_SIZE] = {0, 1, 2, 1, 2, 2};
+  int I,J,i,j,k,l;
+  real lambda,mu;
+  real ctens[MAX_DOF][MAX_DOF][MAX_DOF][MAX_DOF];
+  if (self->tangent)
+  {
+    self->tangent(self,graddef,&lambda,&mu);
+    for (I = 0; I < VOIGT_SIZE; ++ I)
+      for (J = 0; J < VOIGT_SIZE; ++ J)
+        voigt[I][J] = (I < MAX_DOF && J < MAX_DOF ? lambda : 0) +
+          (I == J ? (I < MAX_DOF ? 2*mu : mu) : 0);
+  }
+  else
+  {
+    self->ctensor(self,graddef,ctens);
+    for (I = 0; I < VOIGT_SIZE; ++ I)
+      for (J = 0; J < VOIGT_SIZE; ++ J)
+      {
+        i = voigt_i[I]; j = voigt_j[I];
+        k = voigt_i[J]; l = voigt_j[J];
+        /* symmetrized by minor indexes */
+        voigt[I][J] = (ctens[i][j][k][l] + ctens[j][i][k][l] +
+                       ctens[i][j][l][k] + ctens[j][i][l][k])/4.;
+      }
+  }
+}
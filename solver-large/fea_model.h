@@ -4,6 +4,8 @@
 
 #include "dense_matrix.h"
 
+/* size of the symmetric tensors in Voigt notation */
+#define VOIGT_SIZE 6
 
 /*************************************************************/
 /* Forward declarations                                      */
@@ -29,6 +31,16 @@ typedef void (*stress_func_t)(fea_model_ptr self,
 typedef void (*ctensor_func_t)(fea_model_ptr self,
                                real (*graddef)[MAX_DOF],
                                real (*ctensor)[MAX_DOF][MAX_DOF][MAX_DOF]);
+/*
+ * A pointer to the function for calculating the C elasticity tensor
+ * of the isotropic model in closed form:
+ * C_ijkl = lambda*d_ij*d_kl + mu*(d_ik*d_jl + d_il*d_jk)
+ * by given deformation gradient
+ */
+typedef void (*tangent_func_t)(fea_model_ptr self,
+                               real (*graddef)[MAX_DOF],
+                               real* lambda,
+                               real* mu);
 
 
 /*************************************************************/
@@ -54,6 +66,10 @@ struct fea_model {
   ctensor_func_t ctensor; /* a function pointer to the C elasticity
                            * tensor
                            */
+  tangent_func_t tangent; /* a function pointer to the C elasticity
+                           * tensor in lambda/mu form, 0 if the model
+                           * is not isotropic
+                           */
 };
 
 
@@ -99,6 +115,33 @@ void fea_model_ctensor_compr_neohookean(fea_model_ptr self,
                                         real (*graddef)[MAX_DOF],
                                         real (*ctensor)[MAX_DOF][MAX_DOF][MAX_DOF]);
 
+/*
+ * Calculate lambda and mu of the C tensor of the material model A5
+ * by given deformation gradient
+ */
+void fea_model_tangent_A5(fea_model_ptr self,
+                          real (*graddef)[MAX_DOF],
+                          real* lambda,
+                          real* mu);
+
+/*
+ * Calculate lambda and mu of the symmetrized C tensor of the
+ * Neo-hookean compressible material model by given deformation gradient
+ */
+void fea_model_tangent_compr_neohookean(fea_model_ptr self,
+                                        real (*graddef)[MAX_DOF],
+                                        real* lambda,
+                                        real* mu);
+
+/*
+ * Calculate C tensor of the model in Voigt notation, with
+ * indexes order 11, 22, 33, 12, 23, 13
+ * Uses closed form if the model is isotropic
+ */
+void fea_model_voigt_tangent(fea_model_ptr self,
+                             real (*graddef)[MAX_DOF],
+                             real (*voigt)[VOIGT_SIZE]);
+
 
 
 
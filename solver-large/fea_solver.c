@@ -1,4 +1,6 @@
 /* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* posix_memalign */
+#define _POSIX_C_SOURCE 200112L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,15 +9,20 @@
 #include "dense_matrix.h"
 #include "tests.h"
 #include "sexp_loader.h"
+#include "slae_solvers.h"
+#include "graph_ordering.h"
+#include "element_batch.h"
 
 #include "sp_matrix.h"
-#include "sp_direct.h"
 #include "sp_iter.h"
 #include "sp_file.h"
 #include "sp_utils.h"
 
 #include "logger.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
 /*
@@ -30,21 +37,21 @@
 
 /* Element: TETRAHEDRA10, 4 nodes */
 real gauss_nodes4_tetr10[4][4] = { {(1/4.)/6.,   /* weight */
-                                    0.58541020,  /* a */
-                                    0.13819660,  /* b */
-                                    0.13819660}, /* b */
+                                    TETRAHEDRA10_GAUSS4_A,  /* a */
+                                    TETRAHEDRA10_GAUSS4_B,  /* b */
+                                    TETRAHEDRA10_GAUSS4_B}, /* b */
                                    {(1/4.)/6.,
-                                    0.13819660,  /* b */
-                                    0.58541020,  /* a */
-                                    0.13819660}, /* b */
+                                    TETRAHEDRA10_GAUSS4_B,  /* b */
+                                    TETRAHEDRA10_GAUSS4_A,  /* a */
+                                    TETRAHEDRA10_GAUSS4_B}, /* b */
                                    {(1/4.)/6.,
-                                    0.13819660,  /* b */
-                                    0.13819660,  /* b */
-                                    0.58541020}, /* a */
+                                    TETRAHEDRA10_GAUSS4_B,  /* b */
+                                    TETRAHEDRA10_GAUSS4_B,  /* b */
+                                    TETRAHEDRA10_GAUSS4_A}, /* a */
                                    {(1/4.)/6.,
-                                    0.13819660,  /* b */
-                                    0.13819660,  /* b */
-                                    0.13819660}  /* b */
+                                    TETRAHEDRA10_GAUSS4_B,  /* b */
+                                    TETRAHEDRA10_GAUSS4_B,  /* b */
+                                    TETRAHEDRA10_GAUSS4_B}  /* b */
 };
 /* Element: TETRAHEDRA10, 5 nodes */
 real gauss_nodes5_tetr10[5][4] = { {(-4/5.)/6., 1/4., 1/4., 1/4.},
@@ -78,6 +85,16 @@ int main(int argc, char **argv)
     fprintf(stderr,"Error! Tests failed!\n");
     return 1;
   }
+  /* and the solver tests on request */
+  if (argc == 2 && !strcmp(argv[1],"--tests"))
+  {
+    if (!do_solver_tests())
+    {
+      fprintf(stderr,"Error! Solver tests failed!\n");
+      return 1;
+    }
+    return 0;
+  }
   
   do
   {
@@ -127,6 +144,29 @@ int do_main(char* filename)
   return result;
 }
 
+/*
+ * Log the number of Newton iterations after prefix, followed by
+ * the counters of enabled options: iterations of iterative SLAE
+ * solvers, line search iterations and tangent refreshes
+ */
+static void solver_log_iterations(fea_solver_ptr self,
+                                  const char* prefix,
+                                  int newton,
+                                  int krylov,
+                                  int linesearch,
+                                  int refreshes)
+{
+  char line[256];
+  int n = sprintf(line,"%s%d Newton iterations",prefix,newton);
+  if (self->task_p->solver_type != CHOLESKY)
+    n += sprintf(line + n,", %d SLAE solver iterations",krylov);
+  if (self->task_p->linesearch_max > 0)
+    n += sprintf(line + n,", %d line search iterations",linesearch);
+  if (self->task_p->tangent_refresh_ratio > 0)
+    sprintf(line + n,", %d tangent refreshes",refreshes);
+  LOG("%s",line);
+}
+
 void solve( fea_task_ptr task,
             fea_solution_params_ptr fea_params,
             nodes_array_ptr nodes,
@@ -136,8 +176,12 @@ void solve( fea_task_ptr task,
   /* initialize variables */
   fea_solver_ptr solver = (fea_solver_ptr)0;
   int it = 0;
-  real tolerance;
-  sp_matrix stiffness;
+  real tolerance = 0,tolerance_prev = 0;
+  int newton_total = 0,krylov_total = 0,linesearch_total = 0;
+  int cutbacks = 0,step_refreshes = 0,refreshes_total = 0,tangent_age = 0;
+  real energy = 0,rate,ratio = 0,ratio_prev = 0;
+  char prefix[128];
+  BOOL last,converged,diverged,refresh;
 #ifdef DUMP_DATA
   /* Dump all data in debug version */
   dump_input_data("input.txt",task,fea_params,nodes,elements,presc_boundary);
@@ -156,58 +200,109 @@ void solve( fea_task_ptr task,
   
   LOG("Create elements database");
   solver_create_element_database(solver);
+  LOG("Create colors of elements for the parallel assembly");
+  solver_create_element_colors(solver);
+#ifdef _OPENMP
+  if (task->threads_count > 0)
+    omp_set_num_threads(task->threads_count);
+  LOG("Elements split into %d colors, assembly uses %d threads",
+      solver->colors_count, omp_get_max_threads());
+#else
+  LOG("Elements split into %d colors",solver->colors_count);
+#endif
   LOG("Create an array of shape functions gradients in initial configuration");
   solver_create_initial_shape_gradients(solver);
 
+  /* arc-length continuation replaces the load increment loop */
+  if (solver->task_p->arclength_max > 0)
+    solver_arc_length(solver);
   /* Increment loop starts here */
-  for (; solver->current_load_step < solver->task_p->load_increments_count;
-       ++ solver->current_load_step)
+  while (solver->task_p->arclength_max == 0 &&
+         solver->load < solver->task_p->load_increments_count)
   {
     it = 0;
+    diverged = FALSE;
+    solver->krylov_iterations = 0;
+    solver->linesearch_iterations = 0;
+    /* the last increment shall reach the final load exactly */
+    last = solver->load_increment >=
+      solver->task_p->load_increments_count - solver->load;
+    if (last)
+      solver->load_increment =
+        solver->task_p->load_increments_count - solver->load;
     /* apply prescribed displacements */
-    solver_update_nodes_with_bc(solver, 1);
+    solver_update_nodes_with_bc(solver, solver->load_increment);
 
     /* Create an array of shape functions gradients in current configuration */
     solver_create_current_shape_gradients(solver);
     /* create stresses in order to use them in residual forces and in
-     * initial stress component of the stiffness matrix */
-    solver_create_stresses(solver);
+     * initial stress component of the stiffness matrix, together
+     * with the right-side vector of residual forces (-R) */
+    solver_create_stresses_and_residual_forces(solver);
 
     /* create global stiffness matrix K */
     solver_create_stiffness(solver);
-    /* store global stiffness matrix for modified Newton method */
-    sp_matrix_copy(&solver->global_mtx,&stiffness);
+    refresh = FALSE;
+    step_refreshes = 0;
+    tangent_age = 0;
     do 
     {
       it ++;
 
-      /* create right-side vector of residual forces (-R) */
-      solver_create_residual_forces(solver);
-
-      /* create global stiffness matrix K */
-      if (solver->task_p->modified_newton) 
+      /*
+       * create global stiffness matrix K unless modified Newton
+       * method is used; boundary conditions do not change the matrix,
+       * so in modified Newton method it is used as is until
+       * the tangent refresh policy requires a new one
+       */
+      if ((!solver->task_p->modified_newton && it > 1) || refresh)
       {
-        /*
-         * use stored  stiffness matrix in
-         * modified Newton method
-         */
-        sp_matrix_free(&solver->global_mtx);
-        sp_matrix_copy(&stiffness,&solver->global_mtx);
-      }
-      else                        
-      {
-        /* create global stiffness otherwise */
         solver_create_stiffness(solver);
+        tangent_age = 0;
       }
+      tangent_age ++;
       /* apply prescribed boundary conditions */
       solver_apply_prescribed_bc(solver,0);
+      /* tolerance of iterative solvers from the last energy residuals */
+      solver_update_forcing_term(solver,it,tolerance,tolerance_prev);
+      /*
+       * initial guess for iterative solvers: the extrapolated
+       * increment for the first iteration, zero for Newton corrections.
+       * Until then global_solution_vct keeps the last step for BFGS
+       */
+      if (solver->task_p->bfgs && solver->task_p->modified_newton && it > 1)
+        solver_bfgs_update(solver);
+      /* the Cholesky decomposition doesn't use an initial guess */
+      if (it == 1 && solver->task_p->predictor &&
+          solver->task_p->solver_type != CHOLESKY)
+        solver_create_predictor(solver,solver->global_solution_vct);
+      else
+        memset(solver->global_solution_vct,0,
+               sizeof(real)*solver->global_mtx.rows_count);
       /* solve global equation system K*u=-R */
-      solver_solve_slae(solver);
+      if (solver->task_p->bfgs && solver->task_p->modified_newton)
+        solver_bfgs_solve(solver,it == 1 || refresh);
+      else
+        solver_solve_slae(solver);
       /* check for convergence */
-
+      tolerance_prev = tolerance;
       tolerance = cdot(solver->global_forces_vct,
                        solver->global_solution_vct,
                        solver->global_mtx.rows_count);
+      if (it == 1)
+        energy = tolerance;
+      /* modified Newton: refresh the tangent if convergence slows down */
+      ratio_prev = ratio;
+      ratio = tolerance_prev != 0 ? fabs(tolerance/tolerance_prev) : 0;
+      refresh = fabs(tolerance) > solver->task_p->desired_tolerance &&
+        solver_tangent_refresh_needed(solver,tangent_age,ratio,ratio_prev,
+                                      step_refreshes);
+      if (refresh)
+      {
+        step_refreshes ++;
+        LOG("Tangent stiffness refresh after Newton iteration %d, "
+            "contraction ratio %f",it,ratio);
+      }
     
       LOG("Tolerance <X,R> = %e",tolerance);
       LOG("Newton iteration %d finished",it);
@@ -215,24 +310,85 @@ void solve( fea_task_ptr task,
       /* update nodes array with solution */
       solver_update_nodes_with_solution(solver,solver->global_solution_vct);
       solver_create_current_shape_gradients(solver);
-      solver_create_stresses(solver);
+      solver_create_stresses_and_residual_forces(solver);
+      /* scale the step by the line search */
+      if (solver->task_p->linesearch_max > 0)
+        solver->linesearch_iterations +=
+          solver_line_search(solver,tolerance);
+      /*
+       * with adaptive load steps the increment is cut back as soon as
+       * the energy residual grows over the first one, or the linear
+       * rate of convergence of modified Newton method is too slow to
+       * converge in max_newton_count
+       */
+      if (solver->task_p->adaptive_load_steps && it > 1 &&
+          fabs(tolerance) > solver->task_p->desired_tolerance)
+      {
+        rate = fabs(tolerance/tolerance_prev);
+        diverged = !(fabs(tolerance) <= fabs(energy)) ||
+          (solver->task_p->modified_newton && rate < 1 &&
+           it + log(solver->task_p->desired_tolerance/fabs(tolerance))/
+           log(rate) > solver->task_p->max_newton_count);
+      }
 
     } while ( fabs(tolerance) > solver->task_p->desired_tolerance &&
-              it < task->max_newton_count);
-    /* clear stored stiffness matrix */
-    sp_matrix_free(&stiffness);
+              it < task->max_newton_count && !diverged);
+    converged = fabs(tolerance) <= solver->task_p->desired_tolerance;
     LOG("Load increment %d finished",solver->current_load_step+1);
-    if (it == solver->task_p->max_newton_count)
+    sprintf(prefix,"Load increment %d: ",solver->current_load_step+1);
+    solver_log_iterations(solver,prefix,it,solver->krylov_iterations,
+                          solver->linesearch_iterations,step_refreshes);
+    newton_total += it;
+    krylov_total += solver->krylov_iterations;
+    linesearch_total += solver->linesearch_iterations;
+    refreshes_total += step_refreshes;
+    if (!converged && !solver->task_p->adaptive_load_steps)
     {
-      solver->current_load_step--;
       LOGERROR("Unable to finish load step in %d Newton iterations,exit",
                solver->task_p->max_newton_count);
       break;
     }
+    if (!converged)
+    {
+      /* roll back to the last converged configuration */
+      nodes_array_copy(solver->current_load_step ?
+                       solver->load_steps_p[solver->current_load_step-1].
+                       nodes_p : solver->nodes0_p,
+                       solver->nodes_p);
+      solver->load_increment =
+        solver_adapt_load_increment(solver,solver->load_increment,it,FALSE);
+      cutbacks ++;
+      LOG("Load increment %d cut back to %f",solver->current_load_step+1,
+          solver->load_increment);
+      if (solver->load_increment < LOAD_STEP_MIN)
+      {
+        LOGERROR("Load increment is below %e, exit",LOAD_STEP_MIN);
+        break;
+      }
+      continue;
+    }
+    solver->load = last ? solver->task_p->load_increments_count :
+      solver->load + solver->load_increment;
     /* store current load step */
-    solver_load_step_init(solver,
-                          &solver->load_steps_p[solver->current_load_step],
-                          solver->current_load_step);
+    solver_load_step_store(solver);
+    if (solver->task_p->adaptive_load_steps)
+    {
+      LOG("Load increment %d: load %f of %d",solver->current_load_step,
+          solver->load,solver->task_p->load_increments_count);
+      solver->load_increment =
+        solver_adapt_load_increment(solver,solver->load_increment,it,TRUE);
+    }
+  }
+  /* arc-length method logs its own totals */
+  if (solver->task_p->arclength_max == 0)
+  {
+    if (solver->task_p->adaptive_load_steps)
+      sprintf(prefix,"Total: %d load increments, %d cutbacks, ",
+              solver->current_load_step,cutbacks);
+    else
+      sprintf(prefix,"Total: ");
+    solver_log_iterations(solver,prefix,newton_total,krylov_total,
+                          linesearch_total,refreshes_total);
   }
   /* export solution */
   LOG("Exporting data...");
@@ -242,90 +398,622 @@ void solve( fea_task_ptr task,
 }
 
 
-static BOOL solver_solve_slae_cg(fea_solver_ptr solver,
-                                 sp_matrix_yale_ptr mtx)
+/*
+ * Solve SLAE with the masked global stiffness matrix by PCG with the
+ * preconditioner M, or by CG if M is 0
+ */
+static BOOL solver_solve_slae_pcg(fea_solver_ptr solver,
+                                  slae_operator_t M,
+                                  void* mdata)
 {
   int iter = solver->task_p->solver_max_iter;
-  real tolerance = solver->task_p->solver_tolerance;
-
-  sp_matrix_yale_solve_cg(mtx,
-                          solver->global_forces_vct,
-                          solver->global_forces_vct,
-                          &iter,
-                          &tolerance,
-                          solver->global_solution_vct);
+  real tolerance = solver->slae_tolerance;
+  int size = solver->global_mtx.rows_count;
+  slae_masked_matrix A;
+  A.mtx = &solver->global_mtx;
+  A.symmetric = solver->task_p->symmetric_storage;
+  A.mask = solver->bc_mask;
+  A.work = (real*)malloc(sizeof(real)*size);
+  
+  /* global_solution_vct contains the initial guess */
+  slae_solve_pcg(slae_masked_mv_operator,
+                 &A,
+                 M,
+                 mdata,
+                 size,
+                 solver->global_forces_vct,
+                 solver->global_solution_vct,
+                 &iter,
+                 &tolerance);
+  free(A.work);
+  solver->krylov_iterations += iter;
+  LOGINFO("%s finished in %d iterations, relative residual %e",
+          M ? "PCG" : "CG",iter,tolerance);
   return TRUE;
 }
 
-static BOOL solver_solve_slae_pcg_ilu(fea_solver_ptr solver,
-                                      sp_matrix_yale_ptr mtx)
+static BOOL solver_solve_slae_cg(fea_solver_ptr solver)
 {
-  sp_matrix_skyline_ilu ilu;
+  return solver_solve_slae_pcg(solver,0,0);
+}
+
+static BOOL solver_solve_slae_pcg_block_jacobi(fea_solver_ptr solver)
+{
+  slae_block_jacobi M;
+  BOOL result;
+  /* blocks of d.o.f. of every node, cheap to create for every SLAE */
+  slae_block_jacobi_create(&M,
+                           &solver->global_mtx,
+                           solver->bc_mask,
+                           solver->task_p->dof);
+  result = solver_solve_slae_pcg(solver,slae_block_jacobi_operator,&M);
+  slae_block_jacobi_free(&M);
+  return result;
+}
+
+static BOOL solver_solve_slae_pcg_ic0(fea_solver_ptr solver)
+{
+  if (!solver->ic0.size)
+    slae_ic0_symbolic(&solver->ic0,&solver->global_mtx);
+  /*
+   * as the Cholesky decomposition, IC(0) is reused until the stiffness
+   * matrix is assembled again
+   */
+  if (!solver->ic0.factorized)
+  {
+    if (!slae_ic0_numeric(&solver->ic0,&solver->global_mtx,solver->bc_mask))
+      error("Unable to create IC(0) decomposition");
+    LOGINFO("IC(0) decomposition done with diagonal shift %e",
+            solver->ic0.shift);
+  }
+  return solver_solve_slae_pcg(solver,slae_ic0_operator,&solver->ic0);
+}
+
+static BOOL solver_solve_slae_pcg_ilu(fea_solver_ptr solver)
+{
+  solver_ilu* ilu = &solver->ilu;
+  int i;
 
   int iter = solver->task_p->solver_max_iter;
-  real tolerance = solver->task_p->solver_tolerance;
+  real tolerance = solver->slae_tolerance;
 
-  sp_matrix_create_ilu(&solver->global_mtx, &ilu);
+  /*
+   * ILU decomposition requires the matrix itself, so the boundary
+   * conditions are applied to the copy of the stiffness matrix.
+   * As the Cholesky decomposition, the copy and its decomposition
+   * are reused until the stiffness matrix is assembled again
+   */
+  if (!ilu->factorized)
+  {
+    sp_matrix_copy(&solver->global_mtx,&ilu->masked);
+    for (i = 0; i < ilu->masked.rows_count; ++ i)
+      if (solver->bc_mask[i])
+        sp_matrix_cross_cancellation(&ilu->masked,i);
+    sp_matrix_yale_init(&ilu->yale,&ilu->masked);
+#if 0
+    sp_matrix_yale_save_file(&ilu->yale,"fea_matrix.mtx");
+    exit(1);
+#endif
+    sp_matrix_create_ilu(&ilu->masked,&ilu->ilu);
+    ilu->factorized = TRUE;
+    LOGINFO("ILU decomposition done");
+  }
 
-  sp_matrix_yale_solve_pcg_ilu(mtx,
-                               &ilu,
+  sp_matrix_yale_solve_pcg_ilu(&ilu->yale,
+                               &ilu->ilu,
                                solver->global_forces_vct,
                                solver->global_forces_vct,
                                &iter,
                                &tolerance,
                                solver->global_solution_vct);
 
-  sp_matrix_skyline_ilu_free(&ilu);
+  solver->krylov_iterations += iter;
   return TRUE;
 }
 
-static BOOL solver_solve_slae_cholesky(fea_solver_ptr solver,
-                                       sp_matrix_yale_ptr mtx)
+static BOOL solver_solve_slae_cholesky(fea_solver_ptr solver)
 {
-  if (!solver->symb_chol)
+  int iter;
+  real tolerance;
+  BOOL refined;
+  slae_masked_matrix A;
+  if (!solver->chol.size)
+  {
+    slae_cholesky_symbolic(&solver->chol,&solver->global_mtx);
+    slae_cholesky_single(&solver->chol,solver->task_p->mixed_precision);
+    LOG("Cholesky decomposition has %d nonzeros",
+        solver->chol.offsets[solver->chol.size]);
+  }
+  /*
+   * numeric decomposition is reused until the stiffness matrix
+   * is assembled again, i.e. for all iterations of modified Newton
+   */
+  if (!solver->chol.factorized)
+  {
+    if (!slae_cholesky_numeric(&solver->chol,
+                               &solver->global_mtx,
+                               solver->bc_mask))
+    {
+      if (!solver->chol.values_single ||
+          !solver->task_p->mixed_precision_fallback)
+        error("Unable to solve SLAE using Cholesky decomposition");
+      LOG("Single precision Cholesky decomposition failed, "
+          "switching to double precision");
+      slae_cholesky_single(&solver->chol,FALSE);
+      return solver_solve_slae_cholesky(solver);
+    }
+    LOGINFO("Numeric Cholesky decomposition done");
+  }
+  if (!solver->chol.values_single)
+  {
+    slae_cholesky_solve(&solver->chol,
+                        solver->global_forces_vct,
+                        solver->global_solution_vct);
+    LOGINFO("SLAE solved");
+    return TRUE;
+  }
+  /*
+   * single precision decomposition: the residual of the SLAE is
+   * calculated with the global stiffness matrix in double precision
+   */
+  iter = solver->task_p->solver_max_iter;
+  tolerance = solver->task_p->solver_tolerance;
+  A.mtx = &solver->global_mtx;
+  A.symmetric = solver->task_p->symmetric_storage;
+  A.mask = solver->bc_mask;
+  A.work = (real*)malloc(sizeof(real)*solver->chol.size);
+  refined = slae_cholesky_refine(&solver->chol,
+                                 slae_masked_mv_operator,
+                                 &A,
+                                 solver->global_forces_vct,
+                                 solver->global_solution_vct,
+                                 &iter,
+                                 &tolerance);
+  free(A.work);
+  LOGINFO("Iterative refinement finished in %d iterations, "
+          "relative residual %e",iter,tolerance);
+  if (!refined && solver->task_p->mixed_precision_fallback)
   {
-    solver->symb_chol = calloc(1,sizeof(sp_chol_symbolic));
-    if (!sp_matrix_yale_chol_symbolic(mtx,solver->symb_chol))
-      error("Unable to create symbolic Cholesky decomposition\n");
+    LOG("Iterative refinement stagnated with relative residual %e, "
+        "switching to double precision Cholesky decomposition",tolerance);
+    slae_cholesky_single(&solver->chol,FALSE);
+    return solver_solve_slae_cholesky(solver);
   }
-  if (!sp_matrix_yale_chol_symbolic_solve(mtx,
-                                          solver->symb_chol,
-                                          solver->global_forces_vct,
-                                          solver->global_solution_vct))
-    error("Unable to solve SLAE using Cholesky decomposition");
-  LOGINFO("SLAE solved");
-  return TRUE;  
+  if (!refined)
+    LOGERROR("Iterative refinement stagnated with relative residual %e "
+             "over the tolerance %e",tolerance,
+             solver->task_p->solver_tolerance);
+  return refined;
+}
+
+static void solver_stiffness_product_operator(void* data, real* x, real* y)
+{
+  solver_stiffness_product((fea_solver_ptr)data,x,y);
+}
+
+static BOOL solver_solve_slae_matrix_free(fea_solver_ptr solver)
+{
+  int iter = solver->task_p->solver_max_iter;
+  real tolerance = solver->slae_tolerance;
+  int size = solver->global_mtx.rows_count;
+
+  slae_solve_pcg(solver_stiffness_product_operator,
+                 solver,
+                 slae_jacobi_operator,
+                 &solver->jacobi,
+                 size,
+                 solver->global_forces_vct,
+                 solver->global_solution_vct,
+                 &iter,
+                 &tolerance);
+  solver->krylov_iterations += iter;
+  LOGINFO("Matrix-free PCG finished in %d iterations, relative residual %e",
+          iter,tolerance);
+  return TRUE;
+}
+
+static BOOL solver_solve_slae_pcg_multigrid(fea_solver_ptr solver)
+{
+  if (!solver->multigrid.size)
+  {
+    solver_create_multigrid(solver);
+    LOG("Multigrid coarse level has %d d.o.f.",
+        solver->multigrid.coarse_size);
+  }
+  /* coarse level is reused until the stiffness is assembled again */
+  if (!solver->multigrid.factorized)
+  {
+    if (!slae_twogrid_numeric(&solver->multigrid))
+      error("Unable to create multigrid coarse level");
+    LOGINFO("Multigrid coarse level decomposition done");
+  }
+  return solver_solve_slae_pcg(solver,slae_twogrid_operator,
+                               &solver->multigrid);
 }
 
 BOOL solver_solve_slae(fea_solver_ptr solver)
 {
   BOOL result = FALSE;
-  sp_matrix_yale mtx;
-  sp_matrix_yale_init(&mtx,&solver->global_mtx);
 
-  LOGINFO("Preparing to solve SLAE"); 
-#if 0
-  sp_matrix_yale_save_file(&mtx,"fea_matrix.mtx");
-  exit(1);
-#endif
   LOGINFO("Starting to solve SLAE");
+  /*
+   * the global stiffness matrix is not changed by boundary conditions,
+   * solvers exclude rows and columns of constrained d.o.f. by bc_mask
+   */
   if (solver->task_p->solver_type == CHOLESKY)
-    result = solver_solve_slae_cholesky(solver,&mtx);
+    result = solver_solve_slae_cholesky(solver);
   else if (solver->task_p->solver_type == CG)
-    result = solver_solve_slae_cg(solver,&mtx);
+    result = solver_solve_slae_cg(solver);
   else if (solver->task_p->solver_type == PCG_ILU)
-    result = solver_solve_slae_pcg_ilu(solver,&mtx);
+    result = solver_solve_slae_pcg_ilu(solver);
+  else if (solver->task_p->solver_type == PCG_BLOCK_JACOBI)
+    result = solver_solve_slae_pcg_block_jacobi(solver);
+  else if (solver->task_p->solver_type == PCG_IC0)
+    result = solver_solve_slae_pcg_ic0(solver);
+  else if (solver->task_p->solver_type == PCG_MULTIGRID)
+    result = solver_solve_slae_pcg_multigrid(solver);
+  else if (solver->task_p->solver_type == MATRIX_FREE)
+    result = solver_solve_slae_matrix_free(solver);
+
+  return result;
+}
+
+void solver_bfgs_init(solver_bfgs* self, int size)
+{
+  int i;
+  memset(self,0,sizeof(solver_bfgs));
+  self->size = size;
+  for (i = 0; i < BFGS_MAX_UPDATES; ++ i)
+  {
+    self->s[i] = (real*)malloc(sizeof(real)*size);
+    self->y[i] = (real*)malloc(sizeof(real)*size);
+  }
+  self->forces = (real*)malloc(sizeof(real)*size);
+}
+
+void solver_ilu_free(solver_ilu* self)
+{
+  if (self->factorized)
+  {
+    sp_matrix_skyline_ilu_free(&self->ilu);
+    sp_matrix_yale_free(&self->yale);
+    sp_matrix_free(&self->masked);
+  }
+  memset(self,0,sizeof(solver_ilu));
+}
+
+void solver_bfgs_free(solver_bfgs* self)
+{
+  int i;
+  for (i = 0; i < BFGS_MAX_UPDATES; ++ i)
+  {
+    free(self->s[i]);
+    free(self->y[i]);
+  }
+  free(self->forces);
+  memset(self,0,sizeof(solver_bfgs));
+}
+
+void solver_bfgs_update(fea_solver_ptr self)
+{
+  solver_bfgs* bfgs = &self->bfgs;
+  real* s;
+  real* y;
+  real sy;
+  int i;
+
+  /* drop the oldest update, its vectors are reused */
+  if (bfgs->count == BFGS_MAX_UPDATES)
+  {
+    s = bfgs->s[0];
+    y = bfgs->y[0];
+    for (i = 1; i < BFGS_MAX_UPDATES; ++ i)
+    {
+      bfgs->s[i-1] = bfgs->s[i];
+      bfgs->y[i-1] = bfgs->y[i];
+      bfgs->rho[i-1] = bfgs->rho[i];
+    }
+    bfgs->s[BFGS_MAX_UPDATES-1] = s;
+    bfgs->y[BFGS_MAX_UPDATES-1] = y;
+    bfgs->count --;
+  }
+  s = bfgs->s[bfgs->count];
+  y = bfgs->y[bfgs->count];
+  for (i = 0; i < bfgs->size; ++ i)
+  {
+    s[i] = self->global_solution_vct[i];
+    y[i] = bfgs->forces[i] - self->global_forces_vct[i];
+  }
+  sy = cdot(s,y,bfgs->size);
+  /* the update shall keep the matrix positive definite */
+  if (sy > 0)
+  {
+    bfgs->rho[bfgs->count] = 1/sy;
+    bfgs->count ++;
+  }
+}
 
-  sp_matrix_yale_free(&mtx);
+BOOL solver_bfgs_solve(fea_solver_ptr self, BOOL reset)
+{
+  solver_bfgs* bfgs = &self->bfgs;
+  real* x = self->global_solution_vct;
+  real* q = self->global_forces_vct;
+  int i,k;
+  real beta;
+  BOOL result;
+
+  if (reset)
+    bfgs->count = 0;
+  memcpy(bfgs->forces,q,sizeof(real)*bfgs->size);
+  /* two-loop recursion, from the last update to the first */
+  for (k = bfgs->count - 1; k >= 0; -- k)
+  {
+    bfgs->alpha[k] = bfgs->rho[k]*cdot(bfgs->s[k],q,bfgs->size);
+    for (i = 0; i < bfgs->size; ++ i)
+      q[i] -= bfgs->alpha[k]*bfgs->y[k][i];
+  }
+  result = solver_solve_slae(self);
+  for (k = 0; k < bfgs->count; ++ k)
+  {
+    beta = bfgs->rho[k]*cdot(bfgs->y[k],x,bfgs->size);
+    for (i = 0; i < bfgs->size; ++ i)
+      x[i] += (bfgs->alpha[k] - beta)*bfgs->s[k][i];
+  }
+  /* residual forces are used in the convergence check */
+  memcpy(q,bfgs->forces,sizeof(real)*bfgs->size);
   return result;
 }
 
+/*
+ * Solve SLAE for the tangent displacements dq per unit load factor:
+ * prescribed displacements of the d.o.f. and displacements of free
+ * d.o.f. from the reactions to them. Residual forces are kept
+ */
+static void solver_arc_length_tangent(fea_solver_ptr self,
+                                      real* dq,
+                                      real* work)
+{
+  int size = self->global_mtx.rows_count;
+  real tolerance = self->slae_tolerance;
+  memcpy(work,self->global_forces_vct,sizeof(real)*size);
+  memset(self->global_forces_vct,0,sizeof(real)*size);
+  solver_apply_prescribed_bc(self,1);
+  memset(self->global_solution_vct,0,sizeof(real)*size);
+  self->slae_tolerance = self->task_p->solver_tolerance;
+  solver_solve_slae(self);
+  self->slae_tolerance = tolerance;
+  memcpy(dq,self->global_solution_vct,sizeof(real)*size);
+  memcpy(self->global_forces_vct,work,sizeof(real)*size);
+}
+
+int solver_arc_length(fea_solver_ptr self)
+{
+  int size = self->global_mtx.rows_count;
+  real final = self->task_p->load_increments_count;
+  real* x = self->global_solution_vct;
+  /* tangent displacements, increment of the step and of the last step */
+  real* dq = (real*)malloc(sizeof(real)*size);
+  real* du = (real*)malloc(sizeof(real)*size);
+  real* du_prev = (real*)calloc(size,sizeof(real));
+  real* work = (real*)malloc(sizeof(real)*size);
+  real arc = 0,arc_min = 0;
+  real dlambda,delta,energy = 0,energy_prev = 0;
+  real qq,a,b,c,d,roots[2],cosines[2];
+  int i,k,it,steps = 0,cutbacks = 0,newton_total = 0;
+  BOOL last,converged,failed;
+
+  if (self->task_p->solver_type == MATRIX_FREE)
+    error("Arc-length method is not supported by MATRIX_FREE solver");
+  while (self->load < final && steps < self->task_p->arclength_max)
+  {
+    steps ++;
+    self->krylov_iterations = 0;
+    /* tangent in the last converged configuration */
+    solver_create_current_shape_gradients(self);
+    solver_create_stresses_and_residual_forces(self);
+    solver_create_stiffness(self);
+    solver_arc_length_tangent(self,dq,work);
+    qq = cdot(dq,dq,size);
+    /* the first step has the nominal load increment */
+    if (arc == 0)
+    {
+      arc = sqrt(qq);
+      arc_min = arc*LOAD_STEP_MIN;
+    }
+    /* predictor: follow the path in the direction of the last step */
+    dlambda = arc/sqrt(qq);
+    if (cdot(du_prev,dq,size) < 0)
+      dlambda = -dlambda;
+    /* the last step reaches the final load exactly, by load control */
+    last = self->load + dlambda >= final;
+    if (last)
+      dlambda = final - self->load;
+    for (i = 0; i < size; ++ i)
+      du[i] = dlambda*dq[i];
+    solver_update_nodes_with_solution(self,du);
+    solver_create_current_shape_gradients(self);
+    solver_create_stresses_and_residual_forces(self);
+    it = 0;
+    failed = FALSE;
+    do
+    {
+      it ++;
+      if (!self->task_p->modified_newton && it > 1)
+      {
+        solver_create_stiffness(self);
+        if (!last)
+        {
+          solver_arc_length_tangent(self,dq,work);
+          qq = cdot(dq,dq,size);
+        }
+      }
+      /* residual displacements */
+      solver_apply_prescribed_bc(self,0);
+      solver_update_forcing_term(self,it,energy,energy_prev);
+      memset(x,0,sizeof(real)*size);
+      solver_solve_slae(self);
+      energy_prev = energy;
+      energy = cdot(self->global_forces_vct,x,size);
+      /*
+       * corrector: the load factor change delta keeps the step on the
+       * sphere |du + x + delta*dq| = arc; from 2 roots the one closest
+       * to the direction of du is taken
+       */
+      delta = 0;
+      if (!last)
+      {
+        for (i = 0; i < size; ++ i)
+          work[i] = du[i] + x[i];
+        a = qq;
+        b = 2*cdot(dq,work,size);
+        c = cdot(work,work,size) - arc*arc;
+        d = b*b - 4*a*c;
+        if (d < 0)
+        {
+          failed = TRUE;
+          break;
+        }
+        roots[0] = (-b + sqrt(d))/(2*a);
+        roots[1] = (-b - sqrt(d))/(2*a);
+        for (k = 0; k < 2; ++ k)
+          cosines[k] = cdot(du,work,size) + roots[k]*cdot(du,dq,size);
+        delta = cosines[0] >= cosines[1] ? roots[0] : roots[1];
+      }
+      for (i = 0; i < size; ++ i)
+      {
+        x[i] += delta*dq[i];
+        du[i] += x[i];
+      }
+      dlambda += delta;
+      LOG("Tolerance <X,R> = %e",energy);
+      LOG("Newton iteration %d finished",it);
+      solver_update_nodes_with_solution(self,x);
+      solver_create_current_shape_gradients(self);
+      solver_create_stresses_and_residual_forces(self);
+    } while (fabs(energy) > self->task_p->desired_tolerance &&
+             it < self->task_p->max_newton_count);
+    newton_total += it;
+    converged = !failed &&
+      fabs(energy) <= self->task_p->desired_tolerance;
+    if (!converged)
+    {
+      /* roll back to the last converged configuration */
+      nodes_array_copy(self->current_load_step ?
+                       self->load_steps_p[self->current_load_step-1].
+                       nodes_p : self->nodes0_p,
+                       self->nodes_p);
+      arc *= 0.5;
+      cutbacks ++;
+      LOG("Arc-length step %d failed after %d Newton iterations, "
+          "arc length cut back to %e",steps,it,arc);
+      if (arc < arc_min)
+      {
+        LOGERROR("Arc length is below %e, exit",arc_min);
+        break;
+      }
+      continue;
+    }
+    self->load = last ? final : self->load + dlambda;
+    solver_load_step_store(self);
+    memcpy(du_prev,du,sizeof(real)*size);
+    LOG("Arc-length step %d: load %f, load increment %f, arc length %e, "
+        "%d Newton iterations, %d SLAE solver iterations",steps,
+        self->load,dlambda,arc,it,self->krylov_iterations);
+    /* the arc length grows when Newton method converges quickly */
+    arc = solver_adapt_load_increment(self,arc,it,TRUE);
+  }
+  if (self->load < final)
+    LOGERROR("Arc-length method reached load %f of %d in %d steps",
+             self->load,self->task_p->load_increments_count,steps);
+  LOG("Total: %d arc-length steps, %d cutbacks, %d Newton iterations",
+      steps,cutbacks,newton_total);
+  free(dq);
+  free(du);
+  free(du_prev);
+  free(work);
+  return cutbacks;
+}
+
+real solver_adapt_load_increment(fea_solver_ptr self,
+                                 real increment,
+                                 int newton_count,
+                                 BOOL converged)
+{
+  real factor = 0.5;
+  if (converged)
+  {
+    factor = sqrt((real)self->task_p->desired_newton_count/newton_count);
+    if (factor < 1)
+      factor = 1;
+    else if (factor > LOAD_STEP_GROWTH_MAX)
+      factor = LOAD_STEP_GROWTH_MAX;
+  }
+  return increment*factor;
+}
+
+BOOL solver_tangent_refresh_needed(fea_solver_ptr self,
+                                   int age,
+                                   real ratio,
+                                   real ratio_prev,
+                                   int refreshes)
+{
+  /*
+   * both ratios shall be measured with the same tangent: the first
+   * one after a refresh compares corrections of different matrices
+   */
+  if (!self->task_p->modified_newton ||
+      self->task_p->tangent_refresh_ratio <= 0 ||
+      age < 3 || refreshes >= self->task_p->tangent_refresh_max)
+    return FALSE;
+  /* NaN ratio, i.e. NaN energy, also requires a new tangent */
+  return !(ratio <= self->task_p->tangent_refresh_ratio) &&
+    !(ratio <= ratio_prev);
+}
+
+void solver_update_forcing_term(fea_solver_ptr self,
+                                int it,
+                                real energy,
+                                real energy_prev)
+{
+  real eta_prev = self->slae_tolerance;
+  real eta,safeguard;
+  if (!self->task_p->inexact_newton)
+    eta = self->task_p->solver_tolerance;
+  /* no ratio of residuals in the first 2 iterations of a load step */
+  else if (it <= 2 || energy_prev == 0)
+    eta = FORCING_TERM_MAX;
+  else
+  {
+    /*
+     * energy residual is quadratic in the residual forces, so its
+     * ratio is the squared ratio of norms of residual forces
+     */
+    eta = FORCING_TERM_GAMMA*fabs(energy/energy_prev);
+    /* prevent too fast decrease of the forcing term */
+    safeguard = FORCING_TERM_GAMMA*eta_prev*eta_prev;
+    if (safeguard > 0.1 && safeguard > eta)
+      eta = safeguard;
+    /* prevent oversolving near the convergence */
+    safeguard = energy != 0 ?
+      0.5*sqrt(self->task_p->desired_tolerance/fabs(energy)) : 0;
+    if (safeguard > eta)
+      eta = safeguard;
+    if (eta > FORCING_TERM_MAX)
+      eta = FORCING_TERM_MAX;
+    if (eta < self->task_p->solver_tolerance)
+      eta = self->task_p->solver_tolerance;
+  }
+  self->slae_tolerance = eta;
+  LOGINFO("Tolerance of iterative SLAE solver %e",eta);
+}
+
 
 int parse_cmdargs(int argc, char **argv,char **filename)
 {
   if (argc < 2)
   {
-    printf("Usage: fea_solve input_data.sexp\n");
+    printf("Usage: fea_solve input_data.sexp\n"
+           "       fea_solve --tests\n");
     return 1;
   }
   *filename = argv[1];
@@ -384,24 +1072,52 @@ real solver_node_dof(fea_solver_ptr self,
 }
 
 
+/* number of solver_aligned_calloc calls */
+static int solver_aligned_allocations = 0;
+
+void* solver_aligned_calloc(int count, size_t size)
+{
+  void* ptr = (void*)0;
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+  solver_aligned_allocations ++;
+  if (posix_memalign(&ptr,MEMORY_ALIGNMENT,count*size))
+    error("Unable to allocate memory");
+  memset(ptr,0,count*size);
+  return ptr;
+}
+
+int solver_aligned_allocations_count()
+{
+  return solver_aligned_allocations;
+}
+
 fea_solver* fea_solver_alloc(fea_task_ptr task,
                            fea_solution_params_ptr fea_params,
                            nodes_array_ptr nodes,
                            elements_array_ptr elements,
                            presc_bnd_array_ptr prs_boundary)
 {
-  int msize,bandwidth,elnum,gauss_count,i,j,k,l;
+  int msize,bandwidth,elnum,gauss_count,grads_size;
   /* Allocate structure */
   fea_solver_ptr solver = (fea_solver_ptr)malloc(sizeof(fea_solver));
   /* Copy pointers to the solver structure */
   solver->task_p = task;
   solver->fea_params_p = fea_params;
+  if (fea_params->nodes_per_element > MAX_ELEMENT_NODES)
+    error("Number of nodes per element exceeds MAX_ELEMENT_NODES");
+  if (fea_params->gauss_nodes_count > MAX_GAUSS_NODES)
+    error("Number of gauss nodes exceeds MAX_GAUSS_NODES");
   solver->nodes0_p = nodes;
   solver->nodes_p = nodes_array_copy_alloc(nodes);
   solver->elements_p = elements;
   solver->presc_boundary_p = prs_boundary;
 
   solver->elements_db.gauss_nodes = (gauss_node**)0;
+  solver->colors_count = 0;
+  solver->color_offsets = (int*)0;
+  solver->colored_elements = (int*)0;
   solver_create_element_params(solver);
   fea_model_init(&solver->task_p->model, solver->task_p->model.model);
   
@@ -409,47 +1125,73 @@ fea_solver* fea_solver_alloc(fea_task_ptr task,
    * element/gauss node and arrays of deformation gradients/stresses */
   elnum = elements->elements_count;
   gauss_count = solver->fea_params_p->gauss_nodes_count;
+  grads_size = task->dof*fea_params->nodes_per_element;
   solver->shape_gradients0 =
-    (shape_gradients***)malloc(sizeof(shape_gradients_ptr*)*elnum);
-  solver->shape_gradients  =
-    (shape_gradients***)malloc(sizeof(shape_gradients_ptr*)*elnum);
-  solver->stresses = (tensor**)malloc(sizeof(tensor*)*elnum);
-  solver->graddefs = (tensor**)malloc(sizeof(tensor*)*elnum);
-  for (i = 0; i < elnum; ++ i)
-  {
-    solver->stresses[i] = (tensor*)malloc(sizeof(tensor)*gauss_count);
-    solver->graddefs[i] = (tensor*)malloc(sizeof(tensor)*gauss_count);
-    solver->shape_gradients0[i] =
-      (shape_gradients**)malloc(sizeof(shape_gradients_ptr)*gauss_count);
-    solver->shape_gradients[i] =
-      (shape_gradients**)malloc(sizeof(shape_gradients_ptr)*gauss_count);
-    
-    for (j = 0; j < gauss_count; ++ j)
-    {
-      solver->shape_gradients0[i][j] = (shape_gradients_ptr)0;
-      solver->shape_gradients[i][j] = (shape_gradients_ptr)0;
-      for ( k = 0; k < MAX_DOF; ++ k)
-        for (l = 0; l < MAX_DOF; ++ l)
-        {
-          solver->stresses[i][j].components[k][l] = 0.0;
-          solver->graddefs[i][j].components[k][l] = 0.0;
-        }
-    }
-  }
+    (real*)solver_aligned_calloc(elnum*gauss_count*grads_size,sizeof(real));
+  solver->shape_gradients =
+    (real*)solver_aligned_calloc(elnum*gauss_count*grads_size,sizeof(real));
+  solver->detJ0 = (real*)solver_aligned_calloc(elnum*gauss_count,sizeof(real));
+  solver->detJ = (real*)solver_aligned_calloc(elnum*gauss_count,sizeof(real));
+  solver->stresses =
+    (tensor*)solver_aligned_calloc(elnum*gauss_count,sizeof(tensor));
+  solver->graddefs =
+    (tensor*)solver_aligned_calloc(elnum*gauss_count,sizeof(tensor));
   solver->current_load_step = 0;
+  solver->load = 0;
+  solver->load_increment = 1;
+  solver->slae_tolerance = task->solver_tolerance;
+  solver->load_steps_size = task->load_increments_count;
   solver->load_steps_p = (load_step_ptr)malloc(sizeof(load_step)*
                                                task->load_increments_count);
   /* allocate resources initialize global stiffness matrix */
   /* global matrix size */
   msize = nodes->nodes_count*solver->task_p->dof;
-  /* approximate bandwidth of a global matrix
-   * usually sqrt(msize)*2*/
-  bandwidth = (int)sqrt(msize)*2;
-  sp_matrix_init(&solver->global_mtx,msize,msize,bandwidth,CCS);
-  solver->symb_chol = 0;
+  /*
+   * reorder nodes; the average number of nonzeros in a column of
+   * a global matrix is known from the graph of nodes
+   */
+  bandwidth = solver_create_ordering(solver)*solver->task_p->dof;
+  if (task->symmetric_storage && task->solver_type == PCG_ILU)
+  {
+    LOG("PCG_ILU solver requires full storage of the stiffness matrix");
+    task->symmetric_storage = FALSE;
+  }
+  /* only half of the matrix is stored in symmetric case */
+  if (task->symmetric_storage)
+    bandwidth = bandwidth/2 + solver->task_p->dof;
+  solver->element_slots = (int*)0;
+  solver->sym_row_offsets = (int*)0;
+  solver->sym_row_columns = (int*)0;
+  solver->sym_row_positions = (int*)0;
+  if (task->solver_type == MATRIX_FREE)
+  {
+    /*
+     * the global matrix is never assembled, so neither its pattern
+     * nor values are allocated; only the size of the matrix is used
+     */
+    sp_matrix_init(&solver->global_mtx,msize,msize,1,CCS);
+  }
+  else
+  {
+    sp_matrix_init(&solver->global_mtx,msize,msize,bandwidth,CCS);
+    solver_create_stiffness_pattern(solver);
+  }
+  /* mark constrained d.o.f. */
+  solver->bc_mask = (BOOL*)calloc(msize,sizeof(BOOL));
+  solver_apply_bc_general(solver,solver_mark_single_bc,0);
+  memset(&solver->chol,0,sizeof(slae_cholesky));
+  memset(&solver->ilu,0,sizeof(solver_ilu));
+  memset(&solver->ic0,0,sizeof(slae_ic0));
+  memset(&solver->multigrid,0,sizeof(slae_twogrid));
+  solver->jacobi.size = msize;
+  solver->jacobi.diag = (real*)calloc(msize,sizeof(real));
+  memset(&solver->bfgs,0,sizeof(solver_bfgs));
+  if (task->bfgs && task->modified_newton)
+    solver_bfgs_init(&solver->bfgs,msize);
   /* allocate memory for global forces and solution vectors */
   solver->global_forces_vct = (real*)malloc(sizeof(real)*msize);
   solver->global_solution_vct = (real*)malloc(sizeof(real)*msize);
+  solver->linesearch_vct = (real*)malloc(sizeof(real)*msize);
   memset(solver->global_forces_vct,0,sizeof(real)*msize);
   memset(solver->global_solution_vct,0,sizeof(real)*msize);
   return solver;
@@ -460,25 +1202,11 @@ fea_solver_ptr fea_solver_free(fea_solver_ptr solver)
 {
   /* deallocate resources */
   /* free shape gradients, graddefs and stresses */
-  int elnum = solver->elements_p->elements_count;
-  int gauss_count = solver->fea_params_p->gauss_nodes_count;
-  int i,j;
-  for (i = 0; i < elnum; ++ i)
-  {
-    for (j = 0; j < gauss_count; ++ j)
-    {
-      if (solver->shape_gradients0[i][j])
-        solver_shape_gradients_free(solver,solver->shape_gradients0[i][j]);
-      if (solver->shape_gradients[i][j])
-        solver_shape_gradients_free(solver,solver->shape_gradients[i][j]);
-    }
-    free(solver->shape_gradients0[i]);
-    free(solver->shape_gradients[i]);
-    free(solver->stresses[i]);
-    free(solver->graddefs[i]);
-  }
+  int i;
   free(solver->shape_gradients0);
-  free(solver->shape_gradients);  
+  free(solver->shape_gradients);
+  free(solver->detJ0);
+  free(solver->detJ);
   free(solver->stresses);
   free(solver->graddefs);
   /* free stored load steps */
@@ -487,6 +1215,10 @@ fea_solver_ptr fea_solver_free(fea_solver_ptr solver)
   free(solver->load_steps_p);
   /* deallocate all other resources */
   solver_free_element_database(solver);
+  free(solver->color_offsets);
+  free(solver->colored_elements);
+  free(solver->node_perm);
+  free(solver->node_iperm);
   fea_task_free(solver->task_p);
   fea_solution_params_free(solver->fea_params_p);
   nodes_array_free(solver->nodes0_p);
@@ -494,8 +1226,20 @@ fea_solver_ptr fea_solver_free(fea_solver_ptr solver)
   elements_array_free(solver->elements_p);
   presc_bnd_array_free(solver->presc_boundary_p);
   sp_matrix_free(&solver->global_mtx);
+  free(solver->element_slots);
+  free(solver->sym_row_offsets);
+  free(solver->sym_row_columns);
+  free(solver->sym_row_positions);
+  free(solver->bc_mask);
+  slae_cholesky_free(&solver->chol);
+  solver_ilu_free(&solver->ilu);
+  slae_ic0_free(&solver->ic0);
+  slae_twogrid_free(&solver->multigrid);
+  free(solver->jacobi.diag);
+  solver_bfgs_free(&solver->bfgs);
   free(solver->global_forces_vct);
   free(solver->global_solution_vct);
+  free(solver->linesearch_vct);
   free(solver);
   return (fea_solver_ptr)0;
 }
@@ -582,6 +1326,235 @@ void solver_free_element_database(fea_solver_ptr solver)
   }
 }
 
+void solver_create_element_colors(fea_solver_ptr self)
+{
+  int elnum = self->elements_p->elements_count;
+  int nodes_count = self->nodes0_p->nodes_count;
+  int nelem = self->fea_params_p->nodes_per_element;
+  int el,node,color,i,k;
+  /* node -> elements incidence in compressed form */
+  int* node_offsets = (int*)calloc(nodes_count+1,sizeof(int));
+  int* node_elements = (int*)malloc(sizeof(int)*elnum*nelem);
+  int* colors = (int*)malloc(sizeof(int)*elnum);
+  /* marks[color] == el if color is already used by neighbours of el */
+  int* marks = (int*)malloc(sizeof(int)*(elnum+1));
+
+  for (el = 0; el < elnum; ++ el)
+    for (k = 0; k < nelem; ++ k)
+      node_offsets[self->elements_p->elements[el][k]+1]++;
+  for (node = 0; node < nodes_count; ++ node)
+    node_offsets[node+1] += node_offsets[node];
+  for (el = 0; el < elnum; ++ el)
+    for (k = 0; k < nelem; ++ k)
+    {
+      node = self->elements_p->elements[el][k];
+      node_elements[node_offsets[node]++] = el;
+    }
+  /* restore offsets shifted by the fill loop above */
+  for (node = nodes_count; node > 0; -- node)
+    node_offsets[node] = node_offsets[node-1];
+  node_offsets[0] = 0;
+
+  /* greedy coloring in order of elements */
+  for (el = 0; el <= elnum; ++ el)
+    marks[el] = -1;
+  self->colors_count = 0;
+  for (el = 0; el < elnum; ++ el)
+  {
+    for (k = 0; k < nelem; ++ k)
+    {
+      node = self->elements_p->elements[el][k];
+      for (i = node_offsets[node]; i < node_offsets[node+1]; ++ i)
+        if (node_elements[i] < el)
+          marks[colors[node_elements[i]]] = el;
+    }
+    for (color = 0; marks[color] == el; ++ color);
+    colors[el] = color;
+    if (color + 1 > self->colors_count)
+      self->colors_count = color + 1;
+  }
+
+  /* group elements by colors keeping the order of elements */
+  self->color_offsets = (int*)calloc(self->colors_count+1,sizeof(int));
+  self->colored_elements = (int*)malloc(sizeof(int)*elnum);
+  for (el = 0; el < elnum; ++ el)
+    self->color_offsets[colors[el]+1]++;
+  for (color = 0; color < self->colors_count; ++ color)
+    self->color_offsets[color+1] += self->color_offsets[color];
+  /* use marks as a fill position per color */
+  memcpy(marks,self->color_offsets,sizeof(int)*self->colors_count);
+  for (el = 0; el < elnum; ++ el)
+    self->colored_elements[marks[colors[el]]++] = el;
+
+  free(node_offsets);
+  free(node_elements);
+  free(colors);
+  free(marks);
+}
+
+void solver_create_multigrid(fea_solver_ptr self)
+{
+  /* vertices of the edges of TETRAHEDRA10 with middle nodes 4-9 */
+  static const int edges[6][2] = {{0,1}, {1,2}, {0,2}, {0,3}, {1,3}, {2,3}};
+  int nodes_count = self->nodes_p->nodes_count;
+  int dof = self->task_p->dof;
+  int msize = nodes_count*dof;
+  int* coarse_nodes = (int*)malloc(sizeof(int)*nodes_count);
+  int* indexes = (int*)malloc(sizeof(int)*msize*SLAE_TWOGRID_PROLONG);
+  real* weights = (real*)calloc(msize*SLAE_TWOGRID_PROLONG,sizeof(real));
+  int* element;
+  int coarse_count = 0;
+  int i,e,a,v,k,index;
+  slae_masked_matrix A;
+
+  if (self->task_p->ele_type != TETRAHEDRA10)
+    error("PCG_MULTIGRID solver requires TETRAHEDRA10 elements");
+  for (i = 0; i < nodes_count; ++ i)
+    coarse_nodes[i] = -1;
+  for (i = 0; i < msize*SLAE_TWOGRID_PROLONG; ++ i)
+    indexes[i] = -1;
+  /* vertices in the order of global d.o.f. */
+  for (e = 0; e < self->elements_p->elements_count; ++ e)
+    for (a = 0; a < 4; ++ a)
+      coarse_nodes[self->elements_p->elements[e][a]] = 0;
+  for (i = 0; i < nodes_count; ++ i)
+    if (coarse_nodes[self->node_iperm[i]] != -1)
+      coarse_nodes[self->node_iperm[i]] = coarse_count++;
+  for (e = 0; e < self->elements_p->elements_count; ++ e)
+  {
+    element = self->elements_p->elements[e];
+    for (a = 0; a < 10; ++ a)
+      for (k = 0; k < dof; ++ k)
+      {
+        index = solver_global_dof(self,element[a],k);
+        if (self->bc_mask[index])
+          continue;
+        for (v = 0; v < (a < 4 ? 1 : 2); ++ v)
+        {
+          i = a < 4 ? element[a] : element[edges[a-4][v]];
+          /* constrained vertices have no corrections */
+          if (self->bc_mask[solver_global_dof(self,i,k)])
+            continue;
+          indexes[index*SLAE_TWOGRID_PROLONG + v] = coarse_nodes[i]*dof + k;
+          weights[index*SLAE_TWOGRID_PROLONG + v] = a < 4 ? 1 : 0.5;
+        }
+      }
+  }
+  A.mtx = &self->global_mtx;
+  A.symmetric = self->task_p->symmetric_storage;
+  A.mask = self->bc_mask;
+  slae_twogrid_init(&self->multigrid,&A,coarse_count*dof,indexes,weights,
+                    dof,MULTIGRID_SMOOTHER_DAMPING);
+  free(coarse_nodes);
+}
+
+void solver_create_nodes_graph(fea_solver_ptr self,
+                               int** offsets,
+                               int** adjacency)
+{
+  int elnum = self->elements_p->elements_count;
+  int nodes_count = self->nodes0_p->nodes_count;
+  int nelem = self->fea_params_p->nodes_per_element;
+  int el,node,a,b,i,count;
+  int* element;
+  /* marks[node] == current node if the neighbour is already added */
+  int* marks = (int*)malloc(sizeof(int)*nodes_count);
+  /*
+   * upper bound of the neighbours count of the node is
+   * (nodes per element - 1) * number of elements with the node
+   */
+  int* bounds = (int*)calloc(nodes_count+1,sizeof(int));
+  for (el = 0; el < elnum; ++ el)
+    for (a = 0; a < nelem; ++ a)
+      bounds[self->elements_p->elements[el][a]+1] += nelem - 1;
+  for (node = 0; node < nodes_count; ++ node)
+  {
+    bounds[node+1] += bounds[node];
+    marks[node] = -1;
+  }
+  *adjacency = (int*)malloc(sizeof(int)*(bounds[nodes_count]+1));
+  *offsets = (int*)calloc(nodes_count+1,sizeof(int));
+  /* fill neighbours of every node in its bounds */
+  for (el = 0; el < elnum; ++ el)
+  {
+    element = self->elements_p->elements[el];
+    for (a = 0; a < nelem; ++ a)
+      for (b = 0; b < nelem; ++ b)
+        if (a != b)
+          (*adjacency)[bounds[element[a]] + (*offsets)[element[a]+1]++] =
+            element[b];
+  }
+  /* remove duplicates and compress */
+  count = 0;
+  for (node = 0; node < nodes_count; ++ node)
+  {
+    for (i = bounds[node]; i < bounds[node] + (*offsets)[node+1]; ++ i)
+      if (marks[(*adjacency)[i]] != node)
+      {
+        marks[(*adjacency)[i]] = node;
+        (*adjacency)[count++] = (*adjacency)[i];
+      }
+    (*offsets)[node+1] = count;
+  }
+  free(marks);
+  free(bounds);
+}
+
+int solver_create_ordering(fea_solver_ptr self)
+{
+  int n = self->nodes0_p->nodes_count;
+  int dof = self->task_p->dof;
+  int* offsets;
+  int* adjacency;
+  int i;
+  long fill0,fill;
+  static const char* names[] = {"none","RCM","AMD"};
+  
+  solver_create_nodes_graph(self,&offsets,&adjacency);
+  self->node_perm = (int*)malloc(sizeof(int)*n);
+  self->node_iperm = (int*)malloc(sizeof(int)*n);
+  switch (self->task_p->ordering)
+  {
+  case ORDERING_RCM:
+    graph_ordering_rcm(n,offsets,adjacency,self->node_iperm);
+    break;
+  case ORDERING_AMD:
+    graph_ordering_amd(n,offsets,adjacency,self->node_iperm);
+    break;
+  case ORDERING_NONE:
+  default:
+    for (i = 0; i < n; ++ i)
+      self->node_iperm[i] = i;
+  }
+  for (i = 0; i < n; ++ i)
+    self->node_perm[self->node_iperm[i]] = i;
+
+  /*
+   * d.o.f. of a node are coupled with all d.o.f. of the neighbour
+   * nodes, so every nonzero in a factor of the nodes graph is a dense
+   * dof x dof block, and diagonal blocks are triangular
+   */
+  fill0 = graph_cholesky_fill(n,offsets,adjacency,0);
+  fill = graph_cholesky_fill(n,offsets,adjacency,self->node_iperm);
+  LOG("Ordering of nodes: %s",names[self->task_p->ordering]);
+  LOG("Bandwidth of the stiffness matrix: original %d, reordered %d",
+      (graph_bandwidth(n,offsets,adjacency,0) + 1)*dof - 1,
+      (graph_bandwidth(n,offsets,adjacency,self->node_iperm) + 1)*dof - 1);
+  LOG("Nonzeros in Cholesky decomposition: original %ld, reordered %ld",
+      (fill0 - n)*dof*dof + (long)n*dof*(dof+1)/2,
+      (fill - n)*dof*dof + (long)n*dof*(dof+1)/2);
+  /* average number of nodes connected to a node, including itself */
+  i = (offsets[n] + n - 1)/n + 1;
+  free(offsets);
+  free(adjacency);
+  return i;
+}
+
+int solver_global_dof(fea_solver_ptr self, int node, int dof)
+{
+  return self->node_perm[node]*self->task_p->dof + dof;
+}
+
 void solver_create_element_params_tetrahedra10(fea_solver_ptr solver);
 
 /*
@@ -590,6 +1563,8 @@ void solver_create_element_params_tetrahedra10(fea_solver_ptr solver);
  */
 void solver_create_element_params(fea_solver_ptr solver)
 {
+  /* element types without specialized kernels use generic ones */
+  solver->kernels = batch_kernels_generic;
   switch (solver->task_p->ele_type)
   {
   case TETRAHEDRA10:
@@ -606,46 +1581,41 @@ void solver_load_step_init(fea_solver_ptr self,
                     load_step_ptr step,
                     int step_number)
 {
-  int elnum = self->elements_p->elements_count;
-  int gauss_count = self->fea_params_p->gauss_nodes_count;
-  int i,j,k,l;
+  int size = self->elements_p->elements_count*
+    self->fea_params_p->gauss_nodes_count;
   if (step)
   {
     step->step_number = step_number;
+    step->load = self->load;
     step->nodes_p = nodes_array_copy_alloc(self->nodes_p);
-    step->stresses = (tensor**)malloc(sizeof(tensor*)*elnum);
-    step->graddefs = (tensor**)malloc(sizeof(tensor*)*elnum);
+    step->stresses = (tensor*)solver_aligned_calloc(size,sizeof(tensor));
+    step->graddefs = (tensor*)solver_aligned_calloc(size,sizeof(tensor));
+    memcpy(step->stresses,self->stresses,sizeof(tensor)*size);
+    memcpy(step->graddefs,self->graddefs,sizeof(tensor)*size);
+  }
+}
 
-    for (i = 0; i < elnum; ++ i)
-    {
-      step->stresses[i] = (tensor*)malloc(sizeof(tensor)*gauss_count);
-      step->graddefs[i] = (tensor*)malloc(sizeof(tensor)*gauss_count);    
-      for (j = 0; j < gauss_count; ++ j)
-      {
-        for ( k = 0; k < MAX_DOF; ++ k)
-          for (l = 0; l < MAX_DOF; ++ l)
-          {
-            step->stresses[i][j].components[k][l] =
-              self->stresses[i][j].components[k][l];
-            step->graddefs[i][j].components[k][l] =
-              self->graddefs[i][j].components[k][l];
-          }
-      }
-    }
+void solver_load_step_store(fea_solver_ptr self)
+{
+  /* adaptive load stepping could need more steps than planned */
+  if (self->current_load_step == self->load_steps_size)
+  {
+    self->load_steps_size = self->load_steps_size ?
+      2*self->load_steps_size : 1;
+    self->load_steps_p = (load_step_ptr)realloc(self->load_steps_p,
+                                                sizeof(load_step)*
+                                                self->load_steps_size);
   }
+  solver_load_step_init(self,
+                        &self->load_steps_p[self->current_load_step],
+                        self->current_load_step);
+  self->current_load_step++;
 }
 
 void solver_load_step_free(fea_solver_ptr self, load_step_ptr step)
 {
-  int elnum = self->elements_p->elements_count;
-  int i;
-  if (step)
+  if (self && step)
   {
-    for (i = 0; i < elnum; ++ i)
-    {
-      free(step->stresses[i]);
-      free(step->graddefs[i]);
-    }
     free(step->stresses);
     free(step->graddefs);
     nodes_array_free(step->nodes_p);
@@ -653,18 +1623,19 @@ void solver_load_step_free(fea_solver_ptr self, load_step_ptr step)
 }
 
 
-shape_gradients_ptr solver_shape_gradients_alloc(fea_solver_ptr self,
-                                               nodes_array_ptr nodes,
-                                               int element,
-                                               int gauss)
+BOOL solver_element_gauss_shape_gradients(fea_solver_ptr self,
+                                          nodes_array_ptr nodes,
+                                          int element,
+                                          int gauss,
+                                          real* grads,
+                                          real* detJ)
 {
   int i,j,k;
-  int row_size;
-  real detJ;
+  int nelem = self->fea_params_p->nodes_per_element;
+  real det;
   /* J is a Jacobi matrix of transformation btw local and global */
   /* coordinate systems */
   real J[MAX_DOF][MAX_DOF];
-  shape_gradients_ptr grads = (shape_gradients_ptr)0;
 
   /* Fill an array using Bonet & Wood 7.6(a,b) p.198, 1st edition */
   /* also see Zienkiewitz v1, 6th edition, p.146-147 */
@@ -694,49 +1665,44 @@ shape_gradients_ptr solver_shape_gradients_alloc(fea_solver_ptr self,
         J[i][j] += self->elements_db.gauss_nodes[gauss]->dforms[i][k]* \
           solver_node_dof(self,nodes,element,k,j);
     }
-  if (inv3x3(J,&detJ))                /* inverse exists */
-  {
-    /* Allocate memory for shape gradients */
-    grads = (shape_gradients_ptr)malloc(sizeof(shape_gradients));
-    grads->grads = (real**)malloc(sizeof(real*)*(self->task_p->dof));
-    row_size = sizeof(real)*(self->fea_params_p->nodes_per_element);
-    for (i = 0; i < self->task_p->dof; ++ i)
+  if (!inv3x3(J,&det))                /* inverse doesn't exist */
+    return FALSE;
+  /* Store determinant of the Jacobi matrix */
+  *detJ = det;
+    
+  /* [ dN/dx ]           [ dN/dr ] */
+  /* [ dN/dy ]  = J^-1 * [ dN/ds ] */
+  /* [ dN/dz ]           [ dN/dt ] */
+  for ( i = 0; i < MAX_DOF; ++ i)
+    for ( j = 0; j < nelem; ++ j)
     {
-      grads->grads[i] = (real*)malloc(row_size);
-      memset(grads->grads[i],0,row_size);
+      grads[i*nelem + j] = 0;
+      for ( k = 0; k < MAX_DOF; ++ k)
+        grads[i*nelem + j] += J[i][k]* \
+          self->elements_db.gauss_nodes[gauss]->dforms[k][j];
     }
-    /* Store determinant of the Jacobi matrix */
-    grads->detJ = detJ;
-    
-    /* [ dN/dx ]           [ dN/dr ] */
-    /* [ dN/dy ]  = J^-1 * [ dN/ds ] */
-    /* [ dN/dz ]           [ dN/dt ] */
-    for ( i = 0; i < MAX_DOF; ++ i)
-      for ( j = 0; j < self->fea_params_p->nodes_per_element; ++ j)
-        for ( k = 0; k < MAX_DOF; ++ k)
-          grads->grads[i][j] += J[i][k]* \
-            self->elements_db.gauss_nodes[gauss]->dforms[k][j];
-  }
+  return TRUE;
+}
 
-  return grads;
+int solver_gauss_index(fea_solver_ptr self, int element, int gauss)
+{
+  return element*self->fea_params_p->gauss_nodes_count + gauss;
 }
 
-/* Destructor for the shape gradients array */
-shape_gradients_ptr solver_shape_gradients_free(fea_solver_ptr self,
-                                                shape_gradients_ptr grads)
+real* solver_element_gauss_grads(fea_solver_ptr self,
+                                 BOOL current,
+                                 int element,
+                                 int gauss)
 {
-  int i;
-  /* for (i = 0; i < self->fea_params->nodes_per_element; ++ i */
-  for (i = 0; i < self->task_p->dof; ++ i)
-    free(grads->grads[i]);
-  free(grads->grads);
-  grads->grads = (real**)0;
-  free(grads);
-  return (shape_gradients_ptr)0;
+  return (current ? self->shape_gradients : self->shape_gradients0) +
+    solver_gauss_index(self,element,gauss)*
+    self->task_p->dof*self->fea_params_p->nodes_per_element;
 }
 
 #ifdef DUMP_DATA
-void solver_dump_local_stiffness(fea_solver* self,real **stiff,int el)
+void solver_dump_local_stiffness(fea_solver* self,
+                                 real (*stiff)[MAX_ELEMENT_DOF],
+                                 int el)
 {
   int i,j;
   FILE* f;
@@ -788,8 +1754,33 @@ void solver_create_shape_gradients(fea_solver_ptr self,BOOL current)
 {
   /* prepare an array of shape functions gradients in
    * gauss nodes per element */
-  shape_gradients_ptr grads = (shape_gradients_ptr)0;
   int gauss,element;
+  nodes_array_ptr nodes = current ? self->nodes_p : self->nodes0_p;
+  real* detJ = current ? self->detJ : self->detJ0;
+  if (self->task_p->element_batch)
+  {
+    /* elements are independent, batches are processed in parallel */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (element = 0;
+         element < self->elements_p->elements_count;
+         element += ELEMENT_BATCH_SIZE)
+    {
+      int batch[ELEMENT_BATCH_SIZE];
+      int count;
+      for (count = 0;
+           count < ELEMENT_BATCH_SIZE &&
+             element + count < self->elements_p->elements_count;
+           ++ count)
+        batch[count] = element + count;
+      self->kernels.shape_gradients(self,nodes,
+                                    current ? self->shape_gradients :
+                                    self->shape_gradients0,
+                                    detJ,batch,count);
+    }
+    return;
+  }
   /* loop by elements */
   for ( element = 0;
         element < self->elements_p->elements_count;
@@ -800,29 +1791,18 @@ void solver_create_shape_gradients(fea_solver_ptr self,BOOL current)
          gauss < self->fea_params_p->gauss_nodes_count;
          ++ gauss)
     {
-      /* create shape gradients either in initial or current configuration */
-      grads = solver_shape_gradients_alloc(self,
-                                         current ?
-                                         self->nodes_p : self->nodes0_p,
-                                         element,gauss);
-      if (grads)
-      {
-        /* free previous shape gradients array */
-        if (current)            /* current configuration */
-        {
-          if ( self->shape_gradients[element][gauss] )
-            solver_shape_gradients_free(self,
-                                        self->shape_gradients[element][gauss]);
-          self->shape_gradients[element][gauss] = grads;
-        }
-        else                    /* initial configuration */
-        {
-          if ( self->shape_gradients0[element][gauss] )
-            solver_shape_gradients_free(self,
-                                        self->shape_gradients0[element][gauss]);
-          self->shape_gradients0[element][gauss] = grads;
-        }
-      }
+      /*
+       * create shape gradients either in initial or current configuration,
+       * previous values are kept if the Jacobi matrix is singular
+       */
+      solver_element_gauss_shape_gradients(self,nodes,element,gauss,
+                                           solver_element_gauss_grads(self,
+                                                                      current,
+                                                                      element,
+                                                                      gauss),
+                                           &detJ[solver_gauss_index(self,
+                                                                    element,
+                                                                    gauss)]);
     }
   }
 }
@@ -842,7 +1822,7 @@ void solver_create_initial_shape_gradients(fea_solver_ptr self)
 
 void solver_create_stresses(fea_solver_ptr self)
 {
-  int gauss,el;
+  int gauss,el,index;
   /* loop by elements */
   for ( el = 0;
         el < self->elements_p->elements_count;
@@ -853,9 +1833,10 @@ void solver_create_stresses(fea_solver_ptr self)
          gauss < self->fea_params_p->gauss_nodes_count;
          ++ gauss)
     {
+      index = solver_gauss_index(self,el,gauss);
       solver_element_gauss_stress(self, el, gauss,
-                                  self->graddefs[el][gauss].components,
-                                  self->stresses[el][gauss].components);
+                                  self->graddefs[index].components,
+                                  self->stresses[index].components);
     }
   }
 }
@@ -869,69 +1850,396 @@ void solver_create_residual_forces(fea_solver_ptr self)
     solver_local_residual_forces(self, el);
 }
 
+void solver_create_stresses_and_residual_forces(fea_solver_ptr self)
+{
+  int color,i;
+  /* elements are processed in batches of step elements */
+  int step = self->task_p->element_batch ? ELEMENT_BATCH_SIZE : 1;
+  memset(self->global_forces_vct,0,sizeof(real)*self->global_mtx.rows_count);
+  /*
+   * Elements of the same color have no common nodes, so their
+   * residual forces are added to the different global d.o.f.
+   */
+  for (color = 0; color < self->colors_count; ++ color)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,(16 + step - 1)/step)
+#endif
+    for (i = self->color_offsets[color];
+         i < self->color_offsets[color+1];
+         i += step)
+    {
+      int el = self->colored_elements[i];
+      int count = self->color_offsets[color+1] - i;
+      int gauss,index;
+      if (step > 1)
+      {
+        self->kernels.stresses_and_residual_forces(self,
+                                                   self->colored_elements + i,
+                                                   count < step ? count : step);
+        continue;
+      }
+      /* stresses in gauss nodes of the element ... */
+      for (gauss = 0;
+           gauss < self->fea_params_p->gauss_nodes_count;
+           ++ gauss)
+      {
+        index = solver_gauss_index(self,el,gauss);
+        solver_element_gauss_stress(self, el, gauss,
+                                    self->graddefs[index].components,
+                                    self->stresses[index].components);
+      }
+      /* ... are used immediately for its residual forces */
+      solver_local_residual_forces(self,el);
+    }
+  }
+}
+
 /* Create global stiffness matrix */
 void solver_create_stiffness(fea_solver_ptr self)
 {
-  int el;
+  int color,i;
+  /*
+   * elements are processed in batches of step elements; batched
+   * kernel supports only isotropic models
+   */
+  int step = self->task_p->element_batch && self->task_p->model.tangent ?
+    ELEMENT_BATCH_SIZE : 1;
+  if (self->task_p->solver_type == MATRIX_FREE)
+  {
+    solver_create_stiffness_diagonal(self);
+    return;
+  }
   /* clear global stiffness matrix before constructing a new one */
-  sp_matrix_clear(&self->global_mtx);
-  for (el = 0; el < self->elements_p->elements_count; ++ el)
+  solver_clear_stiffness(self);
+  /*
+   * and invalidate its numeric decompositions; the masked copy for
+   * ILU is freed to keep only one matrix during the assembly
+   */
+  solver_ilu_free(&self->ilu);
+  self->chol.factorized = FALSE;
+  self->ic0.factorized = FALSE;
+  self->multigrid.factorized = FALSE;
+  /*
+   * Elements of the same color do not share nodes, and therefore
+   * write to the different columns of the global matrix. Colors
+   * are processed one after another, so the order of additions
+   * to every matrix element doesn't depend on the number of threads
+   */
+  for (color = 0; color < self->colors_count; ++ color)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,(16 + step - 1)/step)
+#endif
+    for (i = self->color_offsets[color];
+         i < self->color_offsets[color+1];
+         i += step)
+    {
+      /* local stiffness matrix */
+      real stiff[MAX_ELEMENT_DOF][MAX_ELEMENT_DOF];
+      int count = self->color_offsets[color+1] - i;
+      if (step > 1)
+      {
+        self->kernels.stiffness(self,self->colored_elements + i,
+                                count < step ? count : step);
+        continue;
+      }
+      solver_local_stiffness(self,self->colored_elements[i],stiff);
+      solver_local_stiffness_scatter(self,self->colored_elements[i],stiff);
+    }
+  }
+}
+
+
+void solver_create_stiffness_diagonal(fea_solver_ptr self)
+{
+  int color,i;
+  memset(self->jacobi.diag,0,sizeof(real)*self->jacobi.size);
+  for (color = 0; color < self->colors_count; ++ color)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+    for (i = self->color_offsets[color];
+         i < self->color_offsets[color+1];
+         ++ i)
+    {
+      real stiff[MAX_ELEMENT_DOF][MAX_ELEMENT_DOF];
+      int element = self->colored_elements[i];
+      int* nodes = self->elements_p->elements[element];
+      int dof = self->task_p->dof;
+      int a,k;
+      solver_local_stiffness(self,element,stiff);
+      for (a = 0; a < self->fea_params_p->nodes_per_element; ++ a)
+        for (k = 0; k < dof; ++ k)
+          self->jacobi.diag[solver_global_dof(self,nodes[a],k)] +=
+            stiff[a*dof + k][a*dof + k];
+    }
+  }
+}
+
+void solver_stiffness_product(fea_solver_ptr self, real* x, real* y)
+{
+  int color,i;
+  memset(y,0,sizeof(real)*self->jacobi.size);
+  /* elements of the same color write to different rows of y */
+  for (color = 0; color < self->colors_count; ++ color)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+    for (i = self->color_offsets[color];
+         i < self->color_offsets[color+1];
+         ++ i)
+    {
+      /* local vectors of x and y */
+      real v[MAX_ELEMENT_DOF];
+      real w[MAX_ELEMENT_DOF];
+      int indexes[MAX_ELEMENT_DOF];
+      int element = self->colored_elements[i];
+      int dof = self->task_p->dof;
+      int size = self->fea_params_p->nodes_per_element*dof;
+      int a,k;
+      for (a = 0; a < self->fea_params_p->nodes_per_element; ++ a)
+        for (k = 0; k < dof; ++ k)
+          indexes[a*dof + k] =
+            solver_global_dof(self,self->elements_p->elements[element][a],k);
+      /* exclude columns of constrained d.o.f. */
+      for (k = 0; k < size; ++ k)
+        v[k] = self->bc_mask[indexes[k]] ? 0 : x[indexes[k]];
+      solver_local_stiffness_product(self,element,v,w);
+      for (k = 0; k < size; ++ k)
+        y[indexes[k]] += w[k];
+    }
+  }
+  /* rows of constrained d.o.f. contain only diagonal elements */
+  for (i = 0; i < self->jacobi.size; ++ i)
+    if (self->bc_mask[i])
+      y[i] = self->jacobi.diag[i]*x[i];
+}
+
+
+/* sort indexes together with values in ascending order of indexes */
+static void solver_sort_indexed(int* indexes, real* values, int count)
+{
+  int i,j,index;
+  real value;
+  for (i = 1; i < count; ++ i)
   {
-    solver_local_constitutive_part(self,el);
-    solver_local_initial_stess_part(self,el);
+    index = indexes[i];
+    value = values[i];
+    for (j = i; j > 0 && indexes[j-1] > index; -- j)
+    {
+      indexes[j] = indexes[j-1];
+      values[j] = values[j-1];
+    }
+    indexes[j] = index;
+    values[j] = value;
   }
 }
 
+void solver_create_stiffness_pattern(fea_solver_ptr self)
+{
+  int elnum = self->elements_p->elements_count;
+  int nelem = self->fea_params_p->nodes_per_element;
+  int dof = self->task_p->dof;
+  int msize = self->global_mtx.rows_count;
+  BOOL symmetric = self->task_p->symmetric_storage;
+  int el,a,b,i,j,k,row,col,last;
+  int* element;
+  int* positions;
+
+  /* insert all elements of the pattern, values are cleared below */
+  for (el = 0; el < elnum; ++ el)
+  {
+    element = self->elements_p->elements[el];
+    for (a = 0; a < nelem; ++ a)
+      for (b = 0; b < nelem; ++ b)
+        for (i = 0; i < dof; ++ i)
+          for (j = 0; j < dof; ++ j)
+          {
+            row = solver_global_dof(self,element[a],i);
+            col = solver_global_dof(self,element[b],j);
+            /* only upper triangle in case of symmetric storage */
+            if (!symmetric || row <= col)
+              sp_matrix_element_add(&self->global_mtx,row,col,1.0);
+          }
+  }
+  /*
+   * Sort every column by row indexes. Then d.o.f. of a node follow each
+   * other in a column, and since all d.o.f. of a node have the same
+   * pattern, the node block (a,b) starts at the same position in all
+   * d.o.f. columns of the node b
+   */
+  for (col = 0; col < msize; ++ col)
+    solver_sort_indexed(self->global_mtx.storage[col].indexes,
+                        self->global_mtx.storage[col].values,
+                        self->global_mtx.storage[col].last_index + 1);
+  
+  self->element_slots = (int*)malloc(sizeof(int)*elnum*nelem*nelem);
+  for (el = 0; el < elnum; ++ el)
+  {
+    element = self->elements_p->elements[el];
+    for (a = 0; a < nelem; ++ a)
+      for (b = 0; b < nelem; ++ b)
+      {
+        row = solver_global_dof(self,element[a],0);
+        col = solver_global_dof(self,element[b],0);
+        /* lower block is stored as a transposed upper block */
+        if (symmetric && row > col)
+        {
+          row = solver_global_dof(self,element[b],0);
+          col = solver_global_dof(self,element[a],0);
+        }
+        last = self->global_mtx.storage[col].last_index;
+        for (k = 0; k <= last; ++ k)
+          if (self->global_mtx.storage[col].indexes[k] == row)
+            break;
+        assert(k <= last);
+        self->element_slots[(el*nelem + a)*nelem + b] = k;
+      }
+  }
+
+  /* row access to the upper triangle for the boundary conditions */
+  if (symmetric)
+  {
+    self->sym_row_offsets = (int*)calloc(msize+1,sizeof(int));
+    for (col = 0; col < msize; ++ col)
+      for (k = 0; k <= self->global_mtx.storage[col].last_index; ++ k)
+        if (self->global_mtx.storage[col].indexes[k] < col)
+          self->sym_row_offsets[self->global_mtx.storage[col].indexes[k]+1]++;
+    for (row = 0; row < msize; ++ row)
+      self->sym_row_offsets[row+1] += self->sym_row_offsets[row];
+    self->sym_row_columns = (int*)malloc(sizeof(int)*self->sym_row_offsets[msize]);
+    self->sym_row_positions = (int*)malloc(sizeof(int)*self->sym_row_offsets[msize]);
+    positions = (int*)malloc(sizeof(int)*msize);
+    memcpy(positions,self->sym_row_offsets,sizeof(int)*msize);
+    for (col = 0; col < msize; ++ col)
+      for (k = 0; k <= self->global_mtx.storage[col].last_index; ++ k)
+      {
+        row = self->global_mtx.storage[col].indexes[k];
+        if (row < col)
+        {
+          self->sym_row_columns[positions[row]] = col;
+          self->sym_row_positions[positions[row]++] = k;
+        }
+      }
+    free(positions);
+  }
+  solver_clear_stiffness(self);
+}
 
+void solver_clear_stiffness(fea_solver_ptr self)
+{
+  int col;
+  for (col = 0; col < self->global_mtx.rows_count; ++ col)
+    memset(self->global_mtx.storage[col].values,0,
+           sizeof(real)*(self->global_mtx.storage[col].last_index + 1));
+}
 
-void solver_local_constitutive_part(fea_solver_ptr self,int element)
+void solver_local_stiffness(fea_solver_ptr self,
+                            int element,
+                            real (*stiff)[MAX_ELEMENT_DOF])
 {
   /* matrix of gradients of shape functions */
-  shape_gradients_ptr grads = (shape_gradients_ptr)0;
-  int gauss,a,b,i,j,k,l,I,J,globalI,globalJ;
+  real* grads;
+  int gauss,index,a,b,i,j,k,l,I,J;
   real sum;
+  /* initial stress component, the same for all i == j in block */
+  real initial;
+  /* volume of the element multiplied by the weight of gauss node */
+  real factor;
   /* size of a local stiffness matrix */
   int size;
   /* number of nodes per element */
   int nelem;
   /* current number of d.o.f */
   int dof;
-  /* local stiffness matrix */
-  real **stiff = (real**)0;
+  /* lambda and mu of the isotropic C tensor */
+  real lambda,mu;
+  /* g^a.g^b, dot product of gradients of shape functions */
+  real gab;
   /* C tensor depending on material model */
   real ctens[MAX_DOF][MAX_DOF][MAX_DOF][MAX_DOF];
-  
-  real cikjl = 0;
-  /* allocate memory for a local stiffness matrix */
-  size = self->fea_params_p->nodes_per_element*self->task_p->dof;
-  stiff = (real**)malloc(sizeof(real*)*size);
-  for (i = 0; i < size; ++ i)
-  {
-    stiff[i] = (real*)malloc(sizeof(real)*size);
-    memset(stiff[i],0,sizeof(real)*size);
-  }
+  /* symmetrized C tensor, cikjl[i][j][k][l] */
+  real cikjl[MAX_DOF][MAX_DOF][MAX_DOF][MAX_DOF];
+  /* gradients of shape functions in nodes a and b */
+  real ga[MAX_DOF], gb[MAX_DOF];
+  /* stresses in gauss node */
+  real (*stress)[MAX_DOF];
+  fea_model_ptr model = &self->task_p->model;
     
   dof = self->task_p->dof;
   nelem = self->fea_params_p->nodes_per_element;
+  size = nelem*dof;
+  for (I = 0; I < size; ++ I)
+    memset(stiff[I],0,sizeof(real)*size);
   
   /* loop by gauss nodes - numerical integration */
   for (gauss = 0; gauss < self->fea_params_p->gauss_nodes_count ; ++ gauss)
   {
-    /* obtain a C tensor */
-    self->task_p->model.ctensor(&self->task_p->model,
-                                self->graddefs[element][gauss].components,
-                                ctens);
-
-    grads = self->shape_gradients[element][gauss];
-    if (grads)
+    index = solver_gauss_index(self,element,gauss);
+    if (self->detJ[index] != 0)
     {
+      grads = solver_element_gauss_grads(self,TRUE,element,gauss);
+      /*
+       * multiply by volume of an element = det(J)
+       * where divider 6 or 2 or others already accounted in
+       * weights of gauss nodes
+       * ... and weight of the gauss nodes
+       */
+      factor = fabs(self->detJ[index])*
+        self->elements_db.gauss_nodes[gauss]->weight;
+      stress = self->stresses[index].components;
+      /* obtain a C tensor */
+      if (model->tangent)
+        model->tangent(model,self->graddefs[index].components,&lambda,&mu);
+      else
+      {
+        model->ctensor(model,self->graddefs[index].components,ctens);
+        for (i = 0; i < dof; ++ i)
+          for (j = 0; j < dof; ++ j)
+            for (k = 0; k < dof; ++ k)
+              for (l = 0; l < dof; ++ l)
+                cikjl[i][j][k][l] = (ctens[i][k][j][l]+ctens[i][k][l][j]+
+                                     ctens[k][i][j][l]+ctens[k][i][l][j])/4.;
+      }
       /* Construct components of stiffness matrix in
        * indical form using Bonet & Wood 7.35 p.207, 1st edition */
       
-      /* loop by nodes */
+      /* loop by nodes, upper blocks only */
       for ( a = 0; a < nelem; ++ a)
-        for (b = 0; b < nelem; ++ b)
+      {
+        for (k = 0; k < dof; ++ k)
+          ga[k] = grads[k*nelem + a];
+        for (b = a; b < nelem; ++ b)
         {
+          for (k = 0; k < dof; ++ k)
+            gb[k] = grads[k*nelem + b];
+          /* initial stress component of the block [K_{ab}]ij */
+          initial = 0.0;
+          for (k = 0; k < dof; ++ k)
+            for (l = 0; l < dof; ++ l)
+              initial += ga[k]*stress[k][l]*gb[l];
+          if (model->tangent)
+          {
+            /*
+             * for the isotropic C tensor the constitutive part of the
+             * block is lambda*ga_i*gb_j + mu*ga_j*gb_i + mu*(ga.gb)*d_ij
+             */
+            gab = 0.0;
+            for (k = 0; k < dof; ++ k)
+              gab += ga[k]*gb[k];
+            for (i = 0; i < dof; ++ i)
+              for (j = 0; j < dof; ++ j)
+              {
+                sum = lambda*ga[i]*gb[j] + mu*ga[j]*gb[i];
+                if (i == j)
+                  sum += mu*gab + initial;
+                stiff[a*dof + i][b*dof + j] += sum*factor;
+              }
+            continue;
+          }
           /* loop by d.o.f in a stiffness matrix block [K_{ab}]ij, 3x3 */
           for (i = 0; i < dof; ++ i)
             for (j = 0; j < dof; ++ j)
@@ -943,149 +2251,217 @@ void solver_local_constitutive_part(fea_solver_ptr self,int element)
               /* sum of particular derivatives and components of C tensor */
               for (k = 0; k < dof; ++ k)
                 for (l = 0; l < dof; ++ l)
-                {
-                  /* cikjl = ctens[i][k][j][l]; */
-                  cikjl = (ctens[i][k][j][l]+ctens[i][k][l][j]+
-                           ctens[k][i][j][l]+ctens[k][i][l][j])/4.;
-                  sum += 
-                    grads->grads[k][a]*cikjl*grads->grads[l][b];
-                }
-              /*
-               * multiply by volume of an element = det(J)
-               * where divider 6 or 2 or others already accounted in
-               * weights of gauss nodes
-               */
-              sum *= fabs(grads->detJ);
-              /* ... and weight of the gauss nodes for  */
-              sum *= self->elements_db.gauss_nodes[gauss]->weight;
+                  sum += ga[k]*cikjl[i][j][k][l]*gb[l];
+              if (i == j)
+                sum += initial;
               /* append to the local stiffness */
-              stiff[I][J] += sum;
-              /* finally distribute to the global matrix */
-              globalI = self->elements_p->elements[element][a]*dof + i;
-              globalJ = self->elements_p->elements[element][b]*dof + j;
-              sp_matrix_element_add(&self->global_mtx,
-                                    globalI,
-                                    globalJ,
-                                    sum);
+              stiff[I][J] += sum*factor;
             }
         }
+      }
     }
   }
+  /* lower blocks are needed only for full storage */
+  if (!self->task_p->symmetric_storage)
+  {
+    for ( a = 0; a < nelem; ++ a)
+      for (b = a + 1; b < nelem; ++ b)
+        for (i = 0; i < dof; ++ i)
+          for (j = 0; j < dof; ++ j)
+            stiff[b*dof + j][a*dof + i] = stiff[a*dof + i][b*dof + j];
+  }
   
 #ifdef DUMP_DATA
   solver_dump_local_stiffness(self,stiff,element);
 #endif
-  
-  /* clear local stiffness */
-  for ( i = 0; i < size; ++ i )
-    free(stiff[i]);
-  free(stiff);
 }
 
-/* Create initial stress component of the stiffness matrix */
-void solver_local_initial_stess_part(fea_solver_ptr self,int element)
+void solver_local_stiffness_product(fea_solver_ptr self,
+                                    int element,
+                                    real* v,
+                                    real* y)
 {
   /* matrix of gradients of shape functions */
-  shape_gradients_ptr grads = (shape_gradients_ptr)0;
-  int gauss,a,b,i,j,k,l,I,J,globalI,globalJ;
+  real* grads;
+  int gauss,index,a,b,i,j,k,l;
   real sum;
-  /* size of a local stiffness matrix */
-  int size;
+  /* volume of the element multiplied by the weight of gauss node */
+  real factor;
   /* number of nodes per element */
   int nelem;
   /* current number of d.o.f */
   int dof;
-  /* local stiffness matrix */
-  real **stiff = (real**)0;
-  
-  /* allocate memory for a local stiffness matrix */
-  size = self->fea_params_p->nodes_per_element*self->task_p->dof;
-  stiff = (real**)malloc(sizeof(real*)*size);
-  for (i = 0; i < size; ++ i)
-  {
-    stiff[i] = (real*)malloc(sizeof(real)*size);
-    memset(stiff[i],0,sizeof(real)*size);
-  }
-  
+  /* lambda and mu of the isotropic C tensor, trace of L */
+  real lambda,mu,trace;
+  /* gradient of v and the tensor T applied to gradients */
+  real L[MAX_DOF][MAX_DOF];
+  real T[MAX_DOF][MAX_DOF];
+  /* C tensor depending on material model */
+  real ctens[MAX_DOF][MAX_DOF][MAX_DOF][MAX_DOF];
+  /* stresses in gauss node */
+  real (*stress)[MAX_DOF];
+  fea_model_ptr model = &self->task_p->model;
+
   dof = self->task_p->dof;
   nelem = self->fea_params_p->nodes_per_element;
-  
+  memset(y,0,sizeof(real)*nelem*dof);
+
   /* loop by gauss nodes - numerical integration */
   for (gauss = 0; gauss < self->fea_params_p->gauss_nodes_count ; ++ gauss)
   {
-    grads = self->shape_gradients[element][gauss];
-    if (grads)
-    {
-      /* Construct components of stiffness matrix in
-       * indical form using Bonet & Wood 7.35 p.207, 1st edition */
-      
-      /* loop by nodes */
-      for ( a = 0; a < nelem; ++ a)
+    index = solver_gauss_index(self,element,gauss);
+    if (self->detJ[index] == 0)
+      continue;
+    grads = solver_element_gauss_grads(self,TRUE,element,gauss);
+    factor = fabs(self->detJ[index])*
+      self->elements_db.gauss_nodes[gauss]->weight;
+    stress = self->stresses[index].components;
+    /* L_ij = sum_b v_bi*g_bj */
+    for (i = 0; i < dof; ++ i)
+      for (j = 0; j < dof; ++ j)
+      {
+        sum = 0.0;
         for (b = 0; b < nelem; ++ b)
-        {
-          /* loop by d.o.f in a stiffness matrix block [K_{ab}]ij, 3x3 */
-          for (i = 0; i < dof; ++ i)
-            for (j = 0; j < dof; ++ j)
-            {
-              /* indicies in a local stiffness matrix */
-              I = a*dof + i;
-              J = b*dof + j;
-              sum = 0.0;
-              /* sum of particular derivatives and components of C tensor */
-              for (k = 0; k < dof; ++ k)
-                for (l = 0; l < dof; ++ l)
-                  sum += 
-                    grads->grads[k][a] *
-                    self->stresses[element][gauss].components[k][l] *
-                    grads->grads[l][b] *
-                    DELTA(i,j);
-              /*
-               * multiply by volume of an element = det(J)
-               * where divider 6 or 2 or others already accounted in
-               * weights of gauss nodes
-               */
-              sum *= fabs(grads->detJ);
-              /* ... and weight of the gauss nodes for  */
-              sum *= self->elements_db.gauss_nodes[gauss]->weight;
-              /* append to the local stiffness */
-              stiff[I][J] += sum;
-              /* finally distribute to the global matrix */
-              globalI = self->elements_p->elements[element][a]*dof + i;
-              globalJ = self->elements_p->elements[element][b]*dof + j;
-              sp_matrix_element_add(&self->global_mtx,
-                                    globalI,
-                                    globalJ,
-                                    sum);
-            }
-        }
+          sum += v[b*dof + i]*grads[j*nelem + b];
+        L[i][j] = sum;
+      }
+    /* initial stress component T = L*sigma */
+    for (i = 0; i < dof; ++ i)
+      for (k = 0; k < dof; ++ k)
+      {
+        sum = 0.0;
+        for (l = 0; l < dof; ++ l)
+          sum += L[i][l]*stress[l][k];
+        T[i][k] = sum;
+      }
+    /* constitutive component, see solver_local_stiffness */
+    if (model->tangent)
+    {
+      /* T_ik += lambda*tr(L)*d_ik + mu*(L_ik + L_ki) */
+      model->tangent(model,self->graddefs[index].components,&lambda,&mu);
+      trace = 0.0;
+      for (i = 0; i < dof; ++ i)
+        trace += L[i][i];
+      for (i = 0; i < dof; ++ i)
+      {
+        for (k = 0; k < dof; ++ k)
+          T[i][k] += mu*(L[i][k] + L[k][i]);
+        T[i][i] += lambda*trace;
+      }
+    }
+    else
+    {
+      /* T_ik += cikjl[i][j][k][l]*L_jl with the symmetrized C tensor */
+      model->ctensor(model,self->graddefs[index].components,ctens);
+      for (i = 0; i < dof; ++ i)
+        for (k = 0; k < dof; ++ k)
+          for (j = 0; j < dof; ++ j)
+            for (l = 0; l < dof; ++ l)
+              T[i][k] += (ctens[i][k][j][l]+ctens[i][k][l][j]+
+                          ctens[k][i][j][l]+ctens[k][i][l][j])/4.*L[j][l];
     }
+    /* y_a = T*g_a */
+    for (a = 0; a < nelem; ++ a)
+      for (i = 0; i < dof; ++ i)
+      {
+        sum = 0.0;
+        for (k = 0; k < dof; ++ k)
+          sum += T[i][k]*grads[k*nelem + a];
+        y[a*dof + i] += sum*factor;
+      }
   }
-    
-  /* clear local stiffness */
-  for ( i = 0; i < size; ++ i )
-    free(stiff[i]);
-  free(stiff);
 }
 
+void solver_local_stiffness_scatter(fea_solver_ptr self,
+                                    int element,
+                                    real (*stiff)[MAX_ELEMENT_DOF])
+{
+  int a,b,i,j,slot;
+  real* values;
+  int dof = self->task_p->dof;
+  int nelem = self->fea_params_p->nodes_per_element;
+  int* element_nodes = self->elements_p->elements[element];
+  /* positions of the element nodes in the global d.o.f. numbering */
+  int nodes[MAX_ELEMENT_NODES];
+  sp_matrix_ptr mtx = &self->global_mtx;
 
+  for (a = 0; a < nelem; ++ a)
+    nodes[a] = self->node_perm[element_nodes[a]];
+  
+  if (!self->task_p->symmetric_storage)
+  {
+    for (a = 0; a < nelem; ++ a)
+      for (b = 0; b < nelem; ++ b)
+      {
+        /* position of the block in the global matrix columns */
+        slot = self->element_slots[(element*nelem + a)*nelem + b];
+        for (j = 0; j < dof; ++ j)
+        {
+          values = mtx->storage[nodes[b]*dof + j].values + slot;
+          for (i = 0; i < dof; ++ i)
+            values[i] += stiff[a*dof + i][b*dof + j];
+        }
+      }
+    return;
+  }
+  /* symmetric storage: only the upper triangle of global matrix */
+  for (a = 0; a < nelem; ++ a)
+    for (b = a; b < nelem; ++ b)
+    {
+      slot = self->element_slots[(element*nelem + a)*nelem + b];
+      if (nodes[a] < nodes[b])          /* upper block */
+      {
+        for (j = 0; j < dof; ++ j)
+        {
+          values = mtx->storage[nodes[b]*dof + j].values + slot;
+          for (i = 0; i < dof; ++ i)
+            values[i] += stiff[a*dof + i][b*dof + j];
+        }
+      }
+      else if (nodes[a] > nodes[b])     /* lower block, add transposed */
+      {
+        for (i = 0; i < dof; ++ i)
+        {
+          values = mtx->storage[nodes[a]*dof + i].values + slot;
+          for (j = 0; j < dof; ++ j)
+            values[j] += stiff[a*dof + i][b*dof + j];
+        }
+      }
+      else                              /* diagonal block */
+      {
+        for (j = 0; j < dof; ++ j)
+        {
+          values = mtx->storage[nodes[a]*dof + j].values + slot;
+          for (i = 0; i <= j; ++ i)
+            values[i] += stiff[a*dof + i][a*dof + j];
+        }
+      }
+    }
+}
 
-void solver_local_residual_forces(fea_solver_ptr self,int element)
+void solver_local_residual_forces_vector(fea_solver_ptr self,
+                                         int element,
+                                         real* forces)
 {
   /*
    * Calculate residual force vector using formula
    * Bonet & Wood, 1st edition, 7.15
    */
-  int a,i,j,I,gauss;
+  int a,i,j,gauss,index;
   real sum;
-  shape_gradients_ptr grads = (shape_gradients_ptr)0;
+  real* grads;
+  real (*stress)[MAX_DOF];
   int nelem = self->fea_params_p->nodes_per_element;
   int dof = self->task_p->dof;
 
+  memset(forces,0,sizeof(real)*nelem*dof);
   for (gauss = 0; gauss < self->fea_params_p->gauss_nodes_count ; ++ gauss)
   {
-    grads = self->shape_gradients[element][gauss];
-    if (grads)
+    index = solver_gauss_index(self,element,gauss);
+    if (self->detJ[index] != 0)
     {
+      grads = solver_element_gauss_grads(self,TRUE,element,gauss);
+      stress = self->stresses[index].components;
       /* loop by nodes */
       for ( a = 0; a < nelem; ++ a)
         /* loop by d.o.f in a residual vector matrix block T_{ai}, 3x1 */
@@ -1094,23 +2470,35 @@ void solver_local_residual_forces(fea_solver_ptr self,int element)
           sum = 0.0;
           /* sum of particular derivatives and components of C tensor */
           for (j = 0; j < dof; ++ j)
-            sum += self->stresses[element][gauss].components[i][j] *
-              grads->grads[j][a];
+            sum += stress[i][j]*grads[j*nelem + a];
           /*
            * multiply by volume of an element = det(J)
            * where divider 6 or 2 or others already accounted in
            * weights of gauss nodes
            */
-          sum *= fabs(grads->detJ);
+          sum *= fabs(self->detJ[index]);
           /* ... and weight of the gauss node */
           sum *= self->elements_db.gauss_nodes[gauss]->weight;
-          /* finally distribute to the global residual forces vector */
-          I = self->elements_p->elements[element][a]*dof + i;
-          self->global_forces_vct[I] += -sum;
+          forces[a*dof + i] += -sum;
         }
     }
   }
+}
 
+void solver_local_residual_forces(fea_solver_ptr self,int element)
+{
+  int a,i;
+  real forces[MAX_ELEMENT_DOF];
+  int nelem = self->fea_params_p->nodes_per_element;
+  int dof = self->task_p->dof;
+  int* element_nodes = self->elements_p->elements[element];
+
+  solver_local_residual_forces_vector(self,element,forces);
+  /* finally distribute to the global residual forces vector */
+  for (a = 0; a < nelem; ++ a)
+    for (i = 0; i < dof; ++ i)
+      self->global_forces_vct[solver_global_dof(self,element_nodes[a],i)] +=
+        forces[a*dof + i];
 }
 
 
@@ -1137,7 +2525,8 @@ void solver_element_gauss_graddef(fea_solver_ptr self,
    * See Bonet & Wood 7.6(a,b), 7.7 p.198, 1st edition
    */
   real detF = 0;
-  shape_gradients_ptr grads = self->shape_gradients[element][gauss];
+  int nelem = self->fea_params_p->nodes_per_element;
+  real* grads = solver_element_gauss_grads(self,TRUE,element,gauss);
   for (i = 0; i < MAX_DOF; ++ i)
   {
     for (j = 0; j < MAX_DOF; ++ j)
@@ -1145,7 +2534,7 @@ void solver_element_gauss_graddef(fea_solver_ptr self,
       graddef[i][j] = 0;
       for (k = 0; k < self->fea_params_p->nodes_per_element; ++ k)
         graddef[i][j] +=
-          grads->grads[j][k] * 
+          grads[j*nelem + k] * 
           self->nodes0_p->nodes[self->elements_p->elements[element][k]][i];
     }
   }
@@ -1159,6 +2548,8 @@ void solver_element_gauss_graddef(fea_solver_ptr self,
    *                                        dX_j
    * See Bonet & Wood 7.6(a,b), 7.7 p.198, 1st edition
    */
+  int nelem = self->fea_params_p->nodes_per_element;
+  real* grads = solver_element_gauss_grads(self,FALSE,element,gauss);
 
   for (i = 0; i < MAX_DOF; ++ i)
   {
@@ -1167,7 +2558,7 @@ void solver_element_gauss_graddef(fea_solver_ptr self,
       graddef[i][j] = 0;
       for (k = 0; k < self->fea_params_p->nodes_per_element; ++ k)
         graddef[i][j] +=
-          self->shape_gradients0[element][gauss]->grads[j][k] *
+          grads[j*nelem + k] *
           self->nodes_p->nodes[self->elements_p->elements[element][k]][i];
     }
   }
@@ -1220,21 +2611,21 @@ void solver_apply_bc_general(fea_solver_ptr self,apply_bc_t apply,real lambda)
          type == PRESCRIBEDXZ || type == PRESCRIBEDXYZ )
     {
       offset = 0;
-      index = node_number*self->task_p->dof+offset;
+      index = solver_global_dof(self,node_number,offset);
       apply(self, index, presc[offset]);
     }
     if ( type == PRESCRIBEDY || type == PRESCRIBEDXY || 
          type == PRESCRIBEDYZ || type == PRESCRIBEDXYZ )
     {
       offset = 1;
-      index = node_number*self->task_p->dof+offset;
+      index = solver_global_dof(self,node_number,offset);
       apply(self, index, presc[offset]);
     }
     if ( type == PRESCRIBEDZ || type == PRESCRIBEDXZ || 
          type == PRESCRIBEDYZ || type == PRESCRIBEDXYZ )
     {
       offset = 2;
-      index = node_number*self->task_p->dof+offset;
+      index = solver_global_dof(self,node_number,offset);
       apply(self, index, presc[offset]);
     }
   }
@@ -1243,38 +2634,162 @@ void solver_apply_bc_general(fea_solver_ptr self,apply_bc_t apply,real lambda)
 
 void solver_apply_single_bc(fea_solver_ptr self, int index, real presc)
 {
-  real value;
-  int j;
-  /* update global forces vector */
-  /* since matrix is symmetric ith row = ith column */
-  for (j = 0; j <= self->global_mtx.storage[index].last_index; ++ j)
-    self->global_forces_vct[self->global_mtx.storage[index].indexes[j]]
-      -= self->global_mtx.storage[index].values[j]*presc;
-
-  /* cancellation of the 'index' row and column */
-  value = sp_matrix_cross_cancellation(&self->global_mtx,index);
+  real value = 0;
+  int j,row;
+  sp_matrix_ptr mtx = &self->global_mtx;
+  if (self->task_p->solver_type == MATRIX_FREE)
+  {
+    /* without the global matrix only zero values could be applied */
+    if (presc != 0)
+      error("MATRIX_FREE solver supports only zero prescribed values");
+    self->global_forces_vct[index] = 0;
+    return;
+  }
+  /*
+   * move the column 'index' multiplied by prescribed value to the
+   * right-hand side for unconstrained d.o.f.
+   * In case of symmetric storage the column 'index' contains upper part
+   * of the column, the lower part is stored in the row 'index'
+   */
+  for (j = 0; j <= mtx->storage[index].last_index; ++ j)
+  {
+    row = mtx->storage[index].indexes[j];
+    if (row == index)
+      value = mtx->storage[index].values[j];
+    else if (!self->bc_mask[row])
+      self->global_forces_vct[row] -= mtx->storage[index].values[j]*presc;
+  }
+  if (self->task_p->symmetric_storage)
+  {
+    /* right to the diagonal part of the row 'index' */
+    for (j = self->sym_row_offsets[index];
+         j < self->sym_row_offsets[index+1];
+         ++ j)
+    {
+      row = self->sym_row_columns[j];
+      if (!self->bc_mask[row])
+        self->global_forces_vct[row] -=
+          mtx->storage[row].values[self->sym_row_positions[j]]*presc;
+    }
+  }
+  /* the only element left in the row 'index' is a diagonal one */
   self->global_forces_vct[index] = value*presc;
 }
 
+void solver_mark_single_bc(fea_solver_ptr self, int index, real value UNUSED)
+{
+  self->bc_mask[index] = TRUE;
+}
+
 void solver_update_node_with_bc(fea_solver_ptr self,
                                 int index,
                                 real value)
 {
-  int i = index / self->task_p->dof;
+  int i = self->node_iperm[index / self->task_p->dof];
   int j = index % self->task_p->dof;
   self->nodes_p->nodes[i][j] += value;
 }
 
 
 
+void solver_create_predictor(fea_solver_ptr self, real* x)
+{
+  int size = self->nodes_p->nodes_count*self->task_p->dof;
+  int order = self->current_load_step < MAX_PREDICTOR_ORDER ?
+    self->current_load_step : MAX_PREDICTOR_ORDER;
+  /* configurations of the previous load steps, the last first */
+  real (*previous[MAX_PREDICTOR_ORDER+1])[MAX_DOF];
+  /* their load factors and weights of the Lagrange extrapolation */
+  real loads[MAX_PREDICTOR_ORDER+1];
+  real weights[MAX_PREDICTOR_ORDER+1];
+  real load = self->load + self->load_increment;
+  int i,j,k,m,node;
+  real value;
+
+  memset(x,0,sizeof(real)*size);
+  if (order == 0)
+    return;
+  for (k = 0; k <= order; ++ k)
+  {
+    j = self->current_load_step - 1 - k;
+    previous[k] = j >= 0 ? self->load_steps_p[j].nodes_p->nodes :
+      self->nodes0_p->nodes;
+    loads[k] = j >= 0 ? self->load_steps_p[j].load : 0;
+  }
+  /* for equal load steps weights are (2,-1) and (3,-3,1) */
+  for (k = 0; k <= order; ++ k)
+  {
+    weights[k] = 1;
+    for (m = 0; m <= order; ++ m)
+      if (m != k)
+        weights[k] *= (load - loads[m])/(loads[k] - loads[m]);
+  }
+  for (i = 0; i < self->nodes_p->nodes_count; ++ i)
+  {
+    node = self->node_iperm[i];
+    for (j = 0; j < self->task_p->dof; ++ j)
+    {
+      if (self->bc_mask[i*self->task_p->dof + j])
+        continue;
+      value = -self->nodes_p->nodes[node][j];
+      for (k = 0; k <= order; ++ k)
+        value += weights[k]*previous[k][node][j];
+      x[i*self->task_p->dof + j] = value;
+    }
+  }
+}
+
+int solver_line_search(fea_solver_ptr self, real energy)
+{
+  int size = self->global_mtx.rows_count;
+  real* x = self->global_solution_vct;
+  real* dx = self->linesearch_vct;
+  /* step lengths and energies of 2 last points of the secant method */
+  real s_prev = 0, g_prev = energy;
+  real s = 1, g = cdot(self->global_forces_vct,x,size);
+  real s_new;
+  int i,iter = 0;
+
+  if (fabs(g) <= LINESEARCH_TOLERANCE*fabs(energy))
+    return 0;
+  while (iter < self->task_p->linesearch_max && g != g_prev)
+  {
+    s_new = s - g*(s - s_prev)/(g - g_prev);
+    if (s_new < LINESEARCH_STEP_MIN)
+      s_new = LINESEARCH_STEP_MIN;
+    else if (s_new > LINESEARCH_STEP_MAX)
+      s_new = LINESEARCH_STEP_MAX;
+    /* move nodes from the step s to the step s_new */
+    for (i = 0; i < size; ++ i)
+      dx[i] = (s_new - s)*x[i];
+    solver_update_nodes_with_solution(self,dx);
+    solver_create_current_shape_gradients(self);
+    solver_create_stresses_and_residual_forces(self);
+    s_prev = s;
+    g_prev = g;
+    s = s_new;
+    g = cdot(self->global_forces_vct,x,size);
+    iter ++;
+    if (fabs(g) <= LINESEARCH_TOLERANCE*fabs(energy))
+      break;
+  }
+  for (i = 0; i < size; ++ i)
+    x[i] *= s;
+  LOGINFO("Line search finished in %d iterations with step %f",iter,s);
+  return iter;
+}
+
 void solver_update_nodes_with_solution(fea_solver_ptr self,
                                        real* x)
 {
   int i,j;
+  real* node;
+  /* nodes in the solution vector are in order of node_iperm */
   for ( i = 0; i < self->nodes_p->nodes_count; ++ i)
   {
+    node = self->nodes_p->nodes[self->node_iperm[i]];
     for ( j = 0; j < self->task_p->dof; ++ j)
-      self->nodes_p->nodes[i][j] += x[i*self->task_p->dof + j];
+      node[j] += x[i*self->task_p->dof + j];
   }
 }
 
@@ -1404,6 +2919,7 @@ void solver_export_tetrahedra10_gmsh(fea_solver_ptr solver, const char *filename
   FILE* f;
   int i,j,k;
   int load;
+  real time;
  
   f = fopen(filename,"w+");
   if ( f )
@@ -1439,12 +2955,14 @@ void solver_export_tetrahedra10_gmsh(fea_solver_ptr solver, const char *filename
     /* loop by load increments */
     for ( load = 0; load <= solver->current_load_step; ++ load)
     {
+      /* load factor of the step in load increments */
+      time = load ? solver->load_steps_p[load-1].load : 0;
       /* Export displacements */
       fprintf(f,"$NodeData\n");
       fprintf(f,"1\n");
       fprintf(f,"\"Displacements\"\n");
       fprintf(f,"1\n");           /* number-of-real-tags */
-      fprintf(f,"%f\n", load*0.83333333);    /* timestamp */
+      fprintf(f,"%f\n", time*0.83333333);    /* timestamp */
       fprintf(f,"3\n");           /* number-of-integer-tags */
       fprintf(f,"%d\n", load);           /* step index (starting at 0) */
       fprintf(f,"3\n");           /* number of field components (1, 3 or 9)*/
@@ -1465,7 +2983,7 @@ void solver_export_tetrahedra10_gmsh(fea_solver_ptr solver, const char *filename
       fprintf(f,"1\n");           /* number-of-string-tags */
       fprintf(f,"\"Stress tensor\"\n"); /* string tag */
       fprintf(f,"1\n");           /* number-of-real-tags */
-      fprintf(f,"%f\n",load*0.83333333);         /* timestamp */
+      fprintf(f,"%f\n",time*0.83333333);         /* timestamp */
       fprintf(f,"3\n");           /* number-of-integer-tags */
       fprintf(f,"%d\n",load);           /* step index (starting at 0) */
       fprintf(f,"9\n");           /* number of field components (1, 3 or 9) */
@@ -1477,7 +2995,8 @@ void solver_export_tetrahedra10_gmsh(fea_solver_ptr solver, const char *filename
         for ( j = 0; j < MAX_DOF; ++ j)
           for ( k = 0; k < MAX_DOF; ++ k)
             fprintf(f,"%f ", load ?
-                    solver->load_steps_p[load-1].stresses[i][0].components[j][k]
+                    solver->load_steps_p[load-1].stresses[
+                      solver_gauss_index(solver,i,0)].components[j][k]
                     : 0.0); 
         fprintf(f,"\n");
       }
@@ -1496,12 +3015,18 @@ void solver_create_element_params_tetrahedra10(fea_solver* solver)
   {
   case 4:
     solver->elements_db.gauss_nodes_data = gauss_nodes4_tetr10;
+    solver->kernels = batch_kernels_tetrahedra10_4;
     break;
   case 5:
     solver->elements_db.gauss_nodes_data = gauss_nodes5_tetr10;
+    solver->kernels = batch_kernels_tetrahedra10_5;
     break;
   default: error("solver_create_element_params_tetrahedra10: gauss nodes");
   }
+  /* specialized kernels are only for 10 nodes with 3 d.o.f. */
+  if (solver->fea_params_p->nodes_per_element != 10 ||
+      solver->task_p->dof != MAX_DOF)
+    solver->kernels = batch_kernels_generic;
   solver->export_function = solver_export_tetrahedra10_gmsh;
 }
 
@@ -1520,6 +3045,22 @@ fea_task_ptr fea_task_alloc()
   task->max_newton_count = 0;
   task->type = CARTESIAN3D;
   task->modified_newton = TRUE;
+  task->threads_count = 0;
+  task->element_batch = TRUE;
+  task->predictor = TRUE;
+  task->inexact_newton = FALSE;
+  task->bfgs = FALSE;
+  task->tangent_refresh_ratio = 0;
+  task->tangent_refresh_max = TANGENT_REFRESH_MAX;
+  task->adaptive_load_steps = FALSE;
+  task->desired_newton_count = DESIRED_NEWTON_COUNT;
+  task->solver_type = CG;
+  task->solver_tolerance = MAX_ITERATIVE_TOLERANCE;
+  task->solver_max_iter = MAX_ITERATIVE_ITERATIONS;
+  task->mixed_precision = FALSE;
+  task->mixed_precision_fallback = TRUE;
+  task->symmetric_storage = TRUE;
+  task->ordering = ORDERING_RCM;
   task->model.model = MODEL_A5;
   task->model.parameters_count = 2;
   task->model.parameters[0] = 100;
@@ -1561,44 +3102,43 @@ nodes_array_ptr nodes_array_alloc()
   /* allocate memory */
   nodes_array_ptr nodes = (nodes_array_ptr)malloc(sizeof(nodes_array));
   /* set zero values */
-  nodes->nodes = (real**)0;
+  nodes->nodes = (real (*)[MAX_DOF])0;
   nodes->nodes_count = 0;
   return nodes;
 }
 
 nodes_array_ptr nodes_array_copy_alloc(nodes_array_ptr nodes)
 {
-  int i;
   /* allocate memory */
-  nodes_array_ptr copy = (nodes_array_ptr)malloc(sizeof(nodes_array));
-  /* set zero values */
-  copy->nodes = (real**)0;
-  copy->nodes_count = nodes->nodes_count;
+  nodes_array_ptr copy = nodes_array_alloc();
   /* copy nodes */
   if ( nodes->nodes_count && nodes->nodes)
   {
-    copy->nodes = (real**)malloc(sizeof(real*)*copy->nodes_count);
-    for ( i = 0; i < copy->nodes_count; ++ i)
-    {
-      copy->nodes[i] = (real*)malloc(sizeof(real)*MAX_DOF);
-      memcpy(copy->nodes[i],nodes->nodes[i],sizeof(real)*MAX_DOF);
-    }
+    nodes_array_storage_alloc(copy,nodes->nodes_count);
+    nodes_array_copy(nodes,copy);
   }
   return copy;
 }
 
+void nodes_array_storage_alloc(nodes_array_ptr nodes, int nodes_count)
+{
+  nodes->nodes_count = nodes_count;
+  nodes->nodes = (real (*)[MAX_DOF])solver_aligned_calloc(nodes_count,
+                                                         sizeof(real)*MAX_DOF);
+}
+
+void nodes_array_copy(nodes_array_ptr from, nodes_array_ptr to)
+{
+  assert(from->nodes_count == to->nodes_count);
+  memcpy(to->nodes,from->nodes,sizeof(real)*MAX_DOF*from->nodes_count);
+}
+
 /* carefully deallocate nodes array */
 nodes_array_ptr nodes_array_free(nodes_array_ptr nodes)
 {
-  int counter = 0;
   if (nodes)
   {
-    if (nodes->nodes_count && nodes->nodes)
-    {
-      for (; counter < nodes->nodes_count; ++ counter)
-        free(nodes->nodes[counter]);
-      free(nodes->nodes);
-    }
+    free(nodes->nodes);
     free(nodes);
   }
   return (nodes_array_ptr)0;
@@ -10,14 +10,50 @@
 #include <assert.h>
 #include "defines.h"
 #include "sp_matrix.h"
-#include "sp_direct.h"
 #include "dense_matrix.h"
 #include "fea_model.h"
+#include "slae_solvers.h"
 
 /* default value of the tolerance for the iterative solvers */
 #define MAX_ITERATIVE_TOLERANCE 1e-14
 /* default value of the max number of iterations for the iterative solvers */
 #define MAX_ITERATIVE_ITERATIONS 20000
+/* maximum order of the polynomial extrapolation of load steps */
+#define MAX_PREDICTOR_ORDER 2
+/*
+ * parameters of the Eisenstat-Walker forcing terms of the inexact
+ * Newton method: maximum relative tolerance of iterative solvers and
+ * the factor gamma by the ratio of energy residuals
+ */
+#define FORCING_TERM_MAX 0.1
+#define FORCING_TERM_GAMMA 0.9
+/*
+ * line search stops when the energy along the Newton direction drops
+ * below LINESEARCH_TOLERANCE of the energy at the start of the step;
+ * step lengths are limited by [LINESEARCH_STEP_MIN, LINESEARCH_STEP_MAX]
+ */
+#define LINESEARCH_TOLERANCE 0.5
+#define LINESEARCH_STEP_MIN 0.1
+#define LINESEARCH_STEP_MAX 5
+/*
+ * adaptive load stepping: default desired number of Newton iterations
+ * per load step, maximum growth factor of the load increment and
+ * minimum load increment, in fractions of the nominal increment
+ */
+#define DESIRED_NEWTON_COUNT 8
+#define LOAD_STEP_GROWTH_MAX 2
+#define LOAD_STEP_MIN 1e-4
+/* default maximum number of tangent refreshes per load step */
+#define TANGENT_REFRESH_MAX 10
+/* maximum number of stored BFGS updates of the stiffness matrix */
+#define BFGS_MAX_UPDATES 10
+/* damping of the block Jacobi smoother of the multigrid */
+#define MULTIGRID_SMOOTHER_DAMPING 0.6
+/* default value of the max number of iterative refinement iterations */
+#define MAX_REFINEMENT_ITERATIONS 10
+/* coordinates of the 4 gauss nodes of TETRAHEDRA10 */
+#define TETRAHEDRA10_GAUSS4_A 0.58541020
+#define TETRAHEDRA10_GAUSS4_B 0.13819660
 
 /*************************************************************/
 /* Forward declarations                                      */
@@ -62,8 +98,24 @@ typedef enum  {
 typedef enum {
   CG,
   PCG_ILU,
-  CHOLESKY
+  PCG_BLOCK_JACOBI,             /* PCG with nodal block Jacobi */
+  PCG_IC0,                      /* PCG with IC(0) */
+  PCG_MULTIGRID,                /* PCG with two-level multigrid, the
+                                 * coarse level is the linear mesh on
+                                 * vertices of TETRAHEDRA10 elements */
+  CHOLESKY,
+  MATRIX_FREE                   /* Jacobi PCG without the global matrix,
+                                 * see solver_stiffness_product */
 } slae_solver_type;
+
+/* Reordering of the nodes in the global d.o.f. numbering */
+typedef enum {
+  ORDERING_NONE,                /* order of nodes in input data */
+  ORDERING_RCM,                 /* reverse Cuthill-McKee, reduces
+                                 * bandwidth of the stiffness matrix */
+  ORDERING_AMD                  /* approximate minimum degree, reduces
+                                 * fill-in of Cholesky decomposition */
+} ordering_type;
   
 typedef enum  {
   /* TRIANGLE3, TRIANGLE6,TETRAHEDRA4, */
@@ -97,14 +149,56 @@ typedef struct {
   slae_solver_type solver_type; /* SLAE solver */
   real solver_tolerance;        /* tolerance in case of iterative solver */
   int solver_max_iter;          /* max number of iters for iterative solver */
+  BOOL mixed_precision;         /* Cholesky decomposition in single
+                                 * precision with iterative refinement
+                                 * of the solution */
+  BOOL mixed_precision_fallback; /* switch to double precision Cholesky
+                                  * decomposition if the single precision
+                                  * fails or refinement stagnates */
+  BOOL symmetric_storage;       /* store only upper triangle of the
+                                 * global stiffness matrix */
+  ordering_type ordering;       /* reordering of the global d.o.f. */
   int dof;                      /* number of degree of freedom */
   element_type ele_type;        /* type of the element */
-  int load_increments_count;    /* number of load increments */
+  int load_increments_count;    /* number of load increments, i.e.
+                                 * the final load in nominal increments
+                                 * of prescribed displacements */
+  BOOL adaptive_load_steps;     /* change load increments depending on
+                                 * the Newton convergence, see
+                                 * solver_adapt_load_increment */
+  int desired_newton_count;     /* desired number of Newton iterations
+                                 * per adaptive load step */
   real desired_tolerance;       /* desired energy tolerance */
   int max_newton_count;         /* maximum number of Newton's iterations */
   int linesearch_max;           /* maximum number of line searches */
-  int arclength_max;            /* maximum number of arc lenght searches */
+  int arclength_max;            /* maximum number of arc length steps,
+                                 * 0 to use load increments, see
+                                 * solver_arc_length */
   BOOL modified_newton;         /* use modified Newton's method or not */
+  real tangent_refresh_ratio;   /* modified Newton method assembles the
+                                 * stiffness matrix again when the ratio
+                                 * of successive energy residuals is
+                                 * over it and grows; 0 to keep it for
+                                 * a load step,
+                                 * see solver_tangent_refresh_needed */
+  int tangent_refresh_max;      /* maximum number of tangent refreshes
+                                 * per load step */
+  BOOL bfgs;                    /* BFGS updates of the stiffness matrix
+                                 * between its refreshes in modified
+                                 * Newton method, see solver_bfgs_solve */
+  BOOL inexact_newton;          /* relax the tolerance of iterative
+                                 * solvers by the Eisenstat-Walker
+                                 * forcing terms, see
+                                 * solver_update_forcing_term */
+  int threads_count;            /* number of threads used in assembly,
+                                 * 0 means the OpenMP default */
+  BOOL element_batch;           /* use element-batched SIMD kernels
+                                 * in the assembly, see element_batch.h */
+  BOOL predictor;               /* start iterative solvers in the first
+                                 * Newton iteration of a load step from
+                                 * the extrapolated solution, see
+                                 * solver_create_predictor; not used
+                                 * by CHOLESKY solver */
   const char* export_file;      /* export file name - guessing from input */
 } fea_task;
 typedef fea_task* fea_task_ptr;
@@ -123,8 +217,9 @@ typedef fea_solution_params* fea_solution_params_ptr;
 /* An array of nodes. */
 typedef struct {
   int nodes_count;      /* number of input nodes */
-  real **nodes;         /* nodes array,sized as nodes_count x MAX_DOF
-                         * so access is  nodes[node_number][dof] */
+  real (*nodes)[MAX_DOF]; /* contiguous aligned nodes array, sized as
+                           * nodes_count x MAX_DOF
+                           * so access is  nodes[node_number][dof] */
 } nodes_array;
 typedef nodes_array* nodes_array_ptr;
 
@@ -186,23 +281,22 @@ typedef elements_database* elements_database_ptr;
 
 
 /*
- * Matrix of gradients of the shape functions with respect to
- * global coordinates
- * Calculated in one node(gauss node) of an element
- * Layout: [d.o.f x nodes_count]
+ * Gradients of the shape functions with respect to global coordinates
+ * are stored in a flat array per configuration, for all elements and
+ * gauss nodes: [number of elems x gauss nodes] x [dof x nodes_count]
+ * Gradients in the gauss node g of the element el start at the offset
+ * (el*gauss_nodes_count + g)*dof*nodes_per_element, with layout
+ * [dof x nodes_count]:
  *              dN_j(r,s,t)
  * grad[i][j] = -----------
  *                  dX_i
  * 
  * X_1 = x, X_2 = y, X_3 = z coordinates
  * 
+ * Determinants of Jacobi matrices are stored in a separate array
+ * [number of elems x gauss nodes]; zero determinant means what the
+ * gradients in the gauss node were never calculated
  */
-typedef struct {
-  real **grads;                  /* array of derivatives of shape functions
-                                  * [dof x nodes_per_element] */
-  real detJ;                     /* determinant of Jacobi matrix */
-} shape_gradients;
-typedef shape_gradients* shape_gradients_ptr;
 
 /*
  * Load increment step structure.
@@ -211,18 +305,73 @@ typedef shape_gradients* shape_gradients_ptr;
  */
 typedef struct {
   int step_number;
+  real load;                    /* load factor in nominal load increments */
   nodes_array_ptr nodes_p;      /* nodes in current configuration for step */
-  tensor **graddefs;            /* Components of Deformation gradient tensor
+  tensor *graddefs;             /* Components of Deformation gradient tensor
                                  * in gauss nodes
-                                 * array [number of elems] x [gauss nodes]
+                                 * array [number of elems x gauss nodes]
                                  */
-  tensor **stresses;            /* Components of Cauchy stress tensor
+  tensor *stresses;             /* Components of Cauchy stress tensor
                                  * in gauss nodes
-                                 * array [number of elems] x [gauss nodes]
+                                 * array [number of elems x gauss nodes]
                                  */
 } load_step;
 typedef load_step* load_step_ptr;
 
+/*
+ * Limited memory BFGS updates of the inverse of the stiffness matrix.
+ * Updates are the pairs of Newton steps s and changes of the residual
+ * forces y of successive iterations; the oldest pair is dropped
+ * when BFGS_MAX_UPDATES are stored
+ */
+typedef struct {
+  int size;                     /* size of vectors */
+  int count;                    /* number of stored updates */
+  real* s[BFGS_MAX_UPDATES];    /* steps, the last is s[count-1] */
+  real* y[BFGS_MAX_UPDATES];    /* changes of residual forces -R */
+  real rho[BFGS_MAX_UPDATES];   /* 1/<s,y> */
+  real alpha[BFGS_MAX_UPDATES]; /* coefficients of the first loop */
+  real* forces;                 /* residual forces of the last iteration */
+} solver_bfgs;
+
+/*
+ * ILU decomposition for PCG_ILU solver. The library creates it from
+ * the matrix itself, so it is created from the copy of the stiffness
+ * matrix with cancelled rows and columns of constrained d.o.f. The
+ * copy and decomposition are reused until the stiffness matrix
+ * is assembled again
+ */
+typedef struct {
+  sp_matrix masked;             /* masked copy of the stiffness matrix */
+  sp_matrix_yale yale;          /* masked in Yale format */
+  sp_matrix_skyline_ilu ilu;    /* ILU decomposition of masked */
+  BOOL factorized;              /* all the above are created */
+} solver_ilu;
+
+/*
+ * Element kernels processing a batch of count elements at once,
+ * see element_batch.h for description of particular kernels
+ */
+typedef void (*batch_shape_gradients_t)(fea_solver_ptr self,
+                                        nodes_array_ptr nodes,
+                                        real* grads,
+                                        real* detJ,
+                                        int* elements,
+                                        int count);
+typedef void (*batch_elements_t)(fea_solver_ptr self,
+                                 int* elements,
+                                 int count);
+
+/*
+ * Set of element kernels, either generic or specialized for the
+ * particular element type and number of gauss nodes
+ */
+typedef struct {
+  batch_shape_gradients_t shape_gradients;
+  batch_elements_t stresses_and_residual_forces;
+  batch_elements_t stiffness;
+} batch_kernels;
+
 /*
  * A main application structure which shall contain all
  * data necessary for solution
@@ -233,6 +382,8 @@ typedef struct fea_solver_tag {
   isoform_t shape;                /* a function pointer to the shape
                                    * function */
   export_solution_t export_function; /* a pointer to the export function */
+  batch_kernels kernels;          /* element-batched kernels for the
+                                   * element type and gauss nodes */
 
   fea_task_ptr task_p;               
   fea_solution_params_ptr fea_params_p; 
@@ -240,46 +391,115 @@ typedef struct fea_solver_tag {
   nodes_array_ptr nodes_p;              
   elements_array_ptr elements_p;
   presc_bnd_array_ptr presc_boundary_p;
+  int* node_perm;               /* position of the node in the global
+                                 * d.o.f. numbering, the global d.o.f. i
+                                 * of the node is node_perm[node]*dof + i
+                                 */
+  int* node_iperm;              /* node by its position in the global
+                                 * d.o.f. numbering */
+  int colors_count;             /* number of colors of elements */
+  int* color_offsets;           /* offsets of the colors in the
+                                 * colored_elements array,
+                                 * size is colors_count + 1 */
+  int* colored_elements;        /* elements grouped by colors. Elements
+                                 * of the same color share no nodes,
+                                 * therefore could be assembled in
+                                 * parallel */
   elements_database elements_db;  /* array of pre-constructed
                                    * values of derivatives of the
                                    * isoparametric shape functions
                                    * in gauss nodes */
-  shape_gradients_ptr **shape_gradients0; /* an array of gradients of
-                                           * shape functios per element
-                                           * per gauss node in initial
-                                           * configuration
-                                           * [number of elems] x [gauss nodes]  
-                                           */
-  shape_gradients_ptr **shape_gradients; /* an array of gradients of
-                                          * shape functios per element
-                                          * per gauss node in current
-                                          * configuration
-                                          * [number of elems] x [gauss nodes]
-                                          * shall be calculated after update of
-                                          * nodes
-                                          */
-
-  tensor **graddefs;            /* Components of Deformation gradient tensor
+  real* shape_gradients0;       /* an array of gradients of shape
+                                 * functions per element per gauss node
+                                 * in initial configuration, see layout
+                                 * above */
+  real* detJ0;                  /* determinants of Jacobi matrices in
+                                 * initial configuration
+                                 * [number of elems x gauss nodes] */
+  real* shape_gradients;        /* an array of gradients of shape
+                                 * functions per element per gauss node
+                                 * in current configuration, shall be
+                                 * calculated after update of nodes */
+  real* detJ;                   /* determinants of Jacobi matrices in
+                                 * current configuration */
+
+  tensor *graddefs;             /* Components of Deformation gradient tensor
                                  * in gauss nodes
-                                 * array [number of elems] x [gauss nodes]
+                                 * array [number of elems x gauss nodes]
                                  */
-  tensor **stresses;            /* Components of Cauchy stress tensor
+  tensor *stresses;             /* Components of Cauchy stress tensor
                                  * in gauss nodes
-                                 * array [number of elems] x [gauss nodes]
+                                 * array [number of elems x gauss nodes]
                                  */
-  int current_load_step;
+  int current_load_step;        /* number of stored load steps */
+  real load;                    /* load factor of the last stored step,
+                                 * in nominal load increments */
+  real load_increment;          /* increment of the load factor for
+                                 * the current step */
+  int krylov_iterations;        /* number of iterations of iterative
+                                 * SLAE solvers in the current load step */
+  real slae_tolerance;          /* current relative tolerance of
+                                 * iterative SLAE solvers */
+  int linesearch_iterations;    /* number of line search iterations
+                                 * in the current load step */
   load_step_ptr load_steps_p;   /* an array of stored load steps data
-                                 * array size is task_p->load_increments_count
-                                 * load_steps_p[0..current_load_step] shall be
+                                 * array size is load_steps_size, initially
+                                 * task_p->load_increments_count
+                                 * load_steps_p[0..current_load_step-1] are
                                  * filled during load steps iterations
                                  */
+  int load_steps_size;          /* allocated size of load_steps_p */
   sp_matrix global_mtx;         /* global stiffness matrix */
-  sp_chol_symbolic_ptr symb_chol; /* symbolic Cholesky decomposition
-                                   * of the global stiffness matrix
-                                   */
+  int* element_slots;           /* positions of the node blocks of the
+                                 * local stiffness matrices in the columns
+                                 * of the global stiffness matrix
+                                 * [number of elems] x [nodes x nodes].
+                                 * Block (a,b) of element el starts in
+                                 * columns of d.o.f. of node b at the
+                                 * position element_slots[(el*n+a)*n+b]
+                                 * With symmetric storage only blocks
+                                 * with node(a) <= node(b) are stored,
+                                 * and the slot of (a,b) is the slot of
+                                 * the transposed block (b,a) otherwise
+                                 */
+  int* sym_row_offsets;         /* symmetric storage only: elements of
+                                 * the row i right to the diagonal are
+                                 * stored in columns sym_row_columns
+                                 * [sym_row_offsets[i]..
+                                 *  sym_row_offsets[i+1]-1] on positions
+                                 * sym_row_positions[...] */
+  int* sym_row_columns;
+  int* sym_row_positions;
+  BOOL* bc_mask;                /* TRUE for the global d.o.f. with
+                                 * prescribed displacements. Rows and
+                                 * columns of these d.o.f. are excluded
+                                 * from the global stiffness matrix by
+                                 * solvers, so the matrix itself stays
+                                 * unchanged by boundary conditions
+                                 */
+  slae_cholesky chol;           /* Cholesky decomposition of the global
+                                 * stiffness matrix. Symbolic part is
+                                 * created once, numeric part is reused
+                                 * until the stiffness is assembled again.
+                                 * Could be in single precision, see
+                                 * mixed_precision of the task
+                                 */
+  solver_ilu ilu;               /* ILU decomposition for PCG_ILU */
+  slae_ic0 ic0;                 /* IC(0) decomposition of the global
+                                 * stiffness matrix for PCG_IC0, reused
+                                 * as the Cholesky decomposition */
+  slae_twogrid multigrid;       /* two-level preconditioner for
+                                 * PCG_MULTIGRID, reused as the Cholesky
+                                 * decomposition */
+  solver_bfgs bfgs;             /* BFGS updates, if task_p->bfgs */
+  slae_jacobi jacobi;           /* Jacobi preconditioner with the
+                                 * diagonal of the global stiffness
+                                 * matrix, used by MATRIX_FREE solver */
   real* global_forces_vct;      /* external forces vector */
   real* global_reactions_vct;   /* reactions in fixed dofs */
   real* global_solution_vct;    /* vector of global solution */
+  real* linesearch_vct;         /* displacements between the trial
+                                 * steps of solver_line_search */
 } fea_solver;
 
 
@@ -303,6 +523,19 @@ BOOL initial_data_load(char *filename,
 /*************************************************************/
 /* Allocators for internal data structures                   */
 
+/*
+ * Allocate zero-filled array of count elements of given size aligned
+ * by MEMORY_ALIGNMENT bytes. Shall be deallocated with free()
+ */
+void* solver_aligned_calloc(int count, size_t size);
+
+/*
+ * Number of arrays allocated by solver_aligned_calloc so far. Arrays
+ * of per gauss node data are allocated once, so the count shall not
+ * change during Newton iterations
+ */
+int solver_aligned_allocations_count();
+
 /*************************************************************/
 /* Allocators for structures with a data from file           */
 
@@ -314,6 +547,10 @@ fea_solution_params_ptr fea_solution_params_alloc();
 nodes_array_ptr nodes_array_alloc();
 /* create a copy of nodes array */
 nodes_array_ptr nodes_array_copy_alloc(nodes_array_ptr nodes);
+/* Allocate zero-filled storage for nodes_count nodes in nodes array */
+void nodes_array_storage_alloc(nodes_array_ptr nodes, int nodes_count);
+/* Copy coordinates of nodes to the array of the same size */
+void nodes_array_copy(nodes_array_ptr from, nodes_array_ptr to);
 /* Initialize elements array but not initialize particular elements */
 elements_array_ptr elements_array_alloc();
 /* Initialize boundary nodes array but not initialize particular nodes */
@@ -347,17 +584,54 @@ presc_bnd_array_ptr presc_bnd_array_free(presc_bnd_array_ptr presc);
 fea_solver_ptr fea_solver_free(fea_solver_ptr solver);
 
 /*
- * Constructor for the shape functions gradients array
- * element - index of the element to calculate in
- * gauss - index of gauss node
+ * Calculate gradients of shape functions in the gauss node of the element
+ * nodes - nodes array to calculate in
+ * grads - output array [dof x nodes_per_element]
+ * detJ - output determinant of the Jacobi matrix
+ * Returns FALSE and leaves grads and detJ untouched if the Jacobi
+ * matrix is singular
+ */
+BOOL solver_element_gauss_shape_gradients(fea_solver_ptr self,
+                                          nodes_array_ptr nodes,
+                                          int element,
+                                          int gauss,
+                                          real* grads,
+                                          real* detJ);
+
+/*
+ * Creates the graph of nodes connected by elements in compressed form:
+ * neighbours of the node i are adjacency[offsets[i]..offsets[i+1]-1]
+ * Arrays shall be deallocated with free()
  */
-shape_gradients_ptr solver_shape_gradients_alloc(fea_solver_ptr self,
-                                                 nodes_array_ptr nodes,
-                                                 int element,
-                                                 int gauss);
-/* Destructor for the shape gradients array */
-shape_gradients_ptr solver_shape_gradients_free(fea_solver_ptr self,
-                                                shape_gradients_ptr grads);
+void solver_create_nodes_graph(fea_solver_ptr self,
+                               int** offsets,
+                               int** adjacency);
+
+/*
+ * Creates node_perm and node_iperm arrays for the ordering
+ * task_p->ordering and logs bandwidth and Cholesky fill-in for the
+ * original and new ordering.
+ * Returns average number of nodes connected to a node (including itself)
+ */
+int solver_create_ordering(fea_solver_ptr self);
+
+/* Index of the d.o.f. dof of the node in global vectors and matrix */
+int solver_global_dof(fea_solver_ptr self, int node, int dof);
+
+/*
+ * Index of the gauss node of the element in the flat arrays of
+ * shape gradients, deformation gradients and stresses
+ */
+int solver_gauss_index(fea_solver_ptr self, int element, int gauss);
+
+/*
+ * Pointer to the gradients of shape functions [dof x nodes_per_element]
+ * of the element in the gauss node, in current or initial configuration
+ */
+real* solver_element_gauss_grads(fea_solver_ptr self,
+                                 BOOL current,
+                                 int element,
+                                 int gauss);
 
 /*
  * fills the self->shape_gradients or self->shape_gradients0 array
@@ -385,6 +659,12 @@ real solver_node_dof(fea_solver_ptr self,
 void solver_load_step_init(fea_solver_ptr self,
                            load_step_ptr step,
                            int step_number);
+
+/*
+ * Store the current configuration, stresses and load factor as the
+ * next load step, growing the load_steps_p array when needed
+ */
+void solver_load_step_store(fea_solver_ptr self);
             
 /*
  * Desctructor for the load step structure.
@@ -476,6 +756,92 @@ void solve(fea_task_ptr task,
  */
 BOOL solver_solve_slae(fea_solver_ptr solver);
 
+/*
+ * Arc-length continuation (Crisfield's spherical method) instead of
+ * the load increment loop, enabled by arclength_max > 0.
+ * The load factor is not fixed in steps: the increment of the
+ * displacements of all d.o.f. (including prescribed by the load
+ * factor) is kept on the sphere of radius arc length, so steps pass
+ * limit points of the equilibrium path. The first arc length
+ * corresponds to the nominal load increment and it is adapted as the
+ * load increment by solver_adapt_load_increment; failed steps are
+ * rolled back and repeated with the halved arc length. The last step
+ * reaches the final load by load control. Line search and
+ * adaptive load steps settings are not used.
+ * At most arclength_max steps are made.
+ * Returns the number of cutbacks of the arc length
+ */
+int solver_arc_length(fea_solver_ptr self);
+
+/*
+ * Load increment for the next step of adaptive load stepping, after
+ * the step with the load increment increment finished in newton_count
+ * iterations. Converged steps grow the increment by the factor
+ * sqrt(desired_newton_count/newton_count) in [1, LOAD_STEP_GROWTH_MAX]
+ * when Newton method converges quickly; failed steps are repeated
+ * with the halved increment
+ */
+real solver_adapt_load_increment(fea_solver_ptr self,
+                                 real increment,
+                                 int newton_count,
+                                 BOOL converged);
+
+/* Allocate vectors of BFGS updates of the given size */
+void solver_bfgs_init(solver_bfgs* self, int size);
+void solver_bfgs_free(solver_bfgs* self);
+
+/* Free the masked copy and ILU decomposition, if created */
+void solver_ilu_free(solver_ilu* self);
+
+/*
+ * Add the BFGS update of the previous Newton iteration: its step is
+ * in global_solution_vct, residual forces before and after the step
+ * are in bfgs.forces and global_forces_vct. The update is skipped
+ * if its curvature <s,y> is not positive
+ */
+void solver_bfgs_update(fea_solver_ptr self);
+
+/*
+ * Solve SLAE with the stiffness matrix corrected by BFGS updates.
+ * Updates are reset if reset is TRUE, i.e. in the first Newton
+ * iteration with the new assembled stiffness matrix.
+ * The inverse of the updated matrix is applied by the two-loop
+ * recursion around solver_solve_slae with the assembled matrix,
+ * so the decomposition or preconditioner is reused
+ */
+BOOL solver_bfgs_solve(fea_solver_ptr self, BOOL reset);
+
+/*
+ * Tangent refresh policy of modified Newton method: returns TRUE if
+ * the stiffness matrix shall be assembled again after the Newton
+ * iteration made as age-th one with the current stiffness matrix.
+ * ratio is the contraction ratio |energy/energy_prev| of the energy
+ * residuals of this and the previous iteration, ratio_prev the one
+ * of the previous iteration. The tangent is refreshed when the ratio
+ * is over task_p->tangent_refresh_ratio and gets worse, at most
+ * tangent_refresh_max (refreshes made in the load step so far)
+ * times per load step
+ */
+BOOL solver_tangent_refresh_needed(fea_solver_ptr self,
+                                   int age,
+                                   real ratio,
+                                   real ratio_prev,
+                                   int refreshes);
+
+/*
+ * Set the tolerance of iterative solvers slae_tolerance for the Newton
+ * iteration it (starting from 1) of the load step. energy and
+ * energy_prev are energy residuals <X,R> of 2 previous iterations.
+ * Without inexact Newton method the tolerance is solver_tolerance,
+ * otherwise the Eisenstat-Walker forcing term (choice 2, alpha = 2)
+ * gamma*|energy/energy_prev| with safeguards, in the range
+ * [solver_tolerance, FORCING_TERM_MAX]
+ */
+void solver_update_forcing_term(fea_solver_ptr self,
+                                int it,
+                                real energy,
+                                real energy_prev);
+
 #ifdef DUMP_DATA
 /* Dump input data to check if parser works correctly */
 void dump_input_data( char* filename,
@@ -501,6 +867,22 @@ void solver_create_element_database(fea_solver_ptr self);
 /* Destructor for the element database */
 void solver_free_element_database(fea_solver_ptr self);
 
+/*
+ * Split elements into colors in such a way what elements of the
+ * same color have no common nodes. Used for the parallel assembly
+ */
+void solver_create_element_colors(fea_solver_ptr self);
+
+/*
+ * Create the two-level preconditioner self->multigrid. The coarse level
+ * is the linear TETRAHEDRA4 mesh on the vertices (nodes 0-3) of the
+ * TETRAHEDRA10 elements, numbered in the order of the global d.o.f.
+ * Prolongation is the linear interpolation: vertices are copied, middle
+ * nodes of edges get the mean of the edge vertices. Constrained fine
+ * d.o.f. are not used in the prolongation
+ */
+void solver_create_multigrid(fea_solver_ptr self);
+
 
 /*
  * Create an array of shape functions gradients
@@ -520,19 +902,93 @@ void solver_create_stresses(fea_solver_ptr self);
 /* Create global residual forces vector */
 void solver_create_residual_forces(fea_solver_ptr self);
 
-/* Create global stiffness matrix */
+/*
+ * Create stresses in gauss nodes and the global residual forces
+ * vector in one pass by elements, while the element data is
+ * still in cache. Elements are processed by colors in parallel.
+ * Gives the same result as solver_create_stresses followed by
+ * solver_create_residual_forces, which are kept for verification
+ */
+void solver_create_stresses_and_residual_forces(fea_solver_ptr self);
+
+/*
+ * Create global stiffness matrix. With MATRIX_FREE solver
+ * only its diagonal is created, see solver_create_stiffness_diagonal
+ */
 void solver_create_stiffness(fea_solver_ptr self);
 
+/*
+ * Create diagonal of the global stiffness matrix in self->jacobi
+ * from the local stiffness matrices, without the global matrix
+ */
+void solver_create_stiffness_diagonal(fea_solver_ptr self);
+
+/*
+ * Multiplication y = K*x by the global stiffness matrix K without
+ * assembling it: local stiffness matrices are applied element by
+ * element in the current configuration. Constrained d.o.f. are masked
+ * out as in slae_masked_mv; their diagonal elements are taken from
+ * self->jacobi, so solver_create_stiffness_diagonal shall be called
+ * first. Elements are processed by colors in parallel
+ */
+void solver_stiffness_product(fea_solver_ptr self, real* x, real* y);
+
+/*
+ * Create a nonzero pattern of the global stiffness matrix from the
+ * elements table and fill the self->element_slots array.
+ * Since the mesh connectivity doesn't change during the solution,
+ * this is done only once, and the stiffness matrix assembly
+ * is performed by indexed additions into the existing pattern
+ */
+void solver_create_stiffness_pattern(fea_solver_ptr self);
+
+/*
+ * Set all elements of the global stiffness matrix to zero
+ * keeping the nonzero pattern
+ */
+void solver_clear_stiffness(fea_solver_ptr self);
+
 
 /* Update global forces vector with residual forces for the element */
 void solver_local_residual_forces(fea_solver_ptr self,int element);
 
+/*
+ * Calculate residual forces vector of the element
+ * forces - local vector, only first nodes_per_element*dof are used
+ */
+void solver_local_residual_forces_vector(fea_solver_ptr self,
+                                         int element,
+                                         real* forces);
 
-/* Create constitutive component of the stiffness matrix */
-void solver_local_constitutive_part(fea_solver_ptr self,int element);
 
-/* Create initial stress component of the stiffness matrix */
-void solver_local_initial_stess_part(fea_solver_ptr self,int element);
+/*
+ * Create local stiffness matrix of the element: both constitutive
+ * and initial stress components, integrated by all gauss nodes.
+ * stiff - local stiffness matrix, only the first
+ * nodes_per_element*dof rows and columns are used
+ * Only blocks [K_{ab}] with a <= b are calculated; with the full
+ * storage of the global matrix the lower blocks are filled by symmetry
+ */
+void solver_local_stiffness(fea_solver_ptr self,
+                            int element,
+                            real (*stiff)[MAX_ELEMENT_DOF]);
+
+/*
+ * Multiplication y = K*v by the local stiffness matrix K of the element
+ * without creating it. For every gauss node the gradient of v
+ * L = sum_b v_b x g_b gives y_a = T*g_a with
+ * T_ik = C_ijkl*L_jl + (L*sigma)_ik.
+ * v, y - local vectors, only first nodes_per_element*dof are used
+ */
+void solver_local_stiffness_product(fea_solver_ptr self,
+                                    int element,
+                                    real* v,
+                                    real* y);
+
+/* Add the local stiffness matrix of the element to the global matrix */
+void solver_local_stiffness_scatter(fea_solver_ptr self,
+                                    int element,
+                                    real (*stiff)[MAX_ELEMENT_DOF]);
 
 
 /*
@@ -581,12 +1037,17 @@ void solver_apply_bc_general(fea_solver_ptr self,
                              real lambda);
 
 /* Apply BC in form of prescribed displacements to a single specified
- * global d.o.f.
+ * global d.o.f. Only the global forces vector is modified, the
+ * stiffness matrix is used as masked by bc_mask
  * This function is called from solver_apply_prescribed_bc
  */
 void solver_apply_single_bc(fea_solver_ptr self,
                             int index, real value);
 
+/* Mark a single specified global d.o.f. as constrained in bc_mask */
+void solver_mark_single_bc(fea_solver_ptr self,
+                           int index, real value);
+
 /* Add BC in form of prescribed displacements to a single specified
  * global d.o.f. of a global nodes vector
  * This function is called from solver_update_nodes_with_bc */
@@ -594,6 +1055,32 @@ void solver_update_node_with_bc(fea_solver_ptr self,
                                 int index,
                                 real value);
 
+/*
+ * Create the initial guess x for the iterative solution of the first
+ * Newton iteration of the current load step. Configurations of the
+ * previous load steps (and the initial one) are extrapolated by the
+ * polynomial of order up to MAX_PREDICTOR_ORDER, and x is the
+ * difference between the extrapolated and current nodes in the
+ * order of global d.o.f.; zero for constrained d.o.f. and for the
+ * first load step
+ */
+void solver_create_predictor(fea_solver_ptr self, real* x);
+
+/*
+ * Residual-based line search along the Newton direction
+ * global_solution_vct, called after the nodes are updated with the
+ * full step and residual forces are calculated. energy is the energy
+ * residual <X,R> at the start of the step. The step length s is
+ * found by the secant iterations for the root of the energy
+ * <X,R(u + s*X)> along the direction, up to task_p->linesearch_max
+ * iterations. Every iteration needs only the stresses and residual
+ * forces in the new configuration, not the stiffness matrix.
+ * On exit nodes, stresses and residual forces correspond to the
+ * step s, and global_solution_vct is multiplied by s.
+ * Returns the number of line search iterations
+ */
+int solver_line_search(fea_solver_ptr self, real energy);
+
 /*
  * Update array solver->nodes with displacements from vector x
  * This function may be used for:
@@ -0,0 +1,397 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#include <stdlib.h>
+#include <string.h>
+#include "graph_ordering.h"
+
+/* growable list of integers */
+typedef struct {
+  int* items;
+  int count;
+  int capacity;
+} int_list;
+
+static void int_list_push(int_list* list, int value)
+{
+  if (list->count == list->capacity)
+  {
+    list->capacity = list->capacity ? list->capacity*2 : 8;
+    list->items = (int*)realloc(list->items,sizeof(int)*list->capacity);
+  }
+  list->items[list->count++] = value;
+}
+
+static void int_list_free(int_list* list)
+{
+  free(list->items);
+  list->items = (int*)0;
+  list->count = list->capacity = 0;
+}
+
+static int graph_degree(int* offsets, int i)
+{
+  return offsets[i+1] - offsets[i];
+}
+
+/*
+ * Breadth-first search from the root. levels shall be -1 for all
+ * vertices not visited yet. Visited vertices are stored in queue.
+ * Returns number of visited vertices
+ */
+static int graph_bfs(int* offsets, int* adjacency, int root,
+                     int* levels, int* queue)
+{
+  int head = 0, tail = 0;
+  int v,j,u;
+  queue[tail++] = root;
+  levels[root] = 0;
+  while (head < tail)
+  {
+    v = queue[head++];
+    for (j = offsets[v]; j < offsets[v+1]; ++ j)
+    {
+      u = adjacency[j];
+      if (levels[u] == -1)
+      {
+        levels[u] = levels[v] + 1;
+        queue[tail++] = u;
+      }
+    }
+  }
+  return tail;
+}
+
+/*
+ * Find a pseudo-peripheral vertex in the connected component of
+ * the vertex start, by George-Liu algorithm
+ */
+static int graph_pseudo_peripheral(int* offsets, int* adjacency, int start,
+                                   int* levels, int* queue)
+{
+  int root = start;
+  int count,ecc,best,q,i;
+  count = graph_bfs(offsets,adjacency,root,levels,queue);
+  ecc = levels[queue[count-1]];
+  while (TRUE)
+  {
+    /* vertex of minimum degree in the last level */
+    best = queue[count-1];
+    for (q = count - 1; q >= 0 && levels[queue[q]] == ecc; -- q)
+      if (graph_degree(offsets,queue[q]) < graph_degree(offsets,best))
+        best = queue[q];
+    for (i = 0; i < count; ++ i)
+      levels[queue[i]] = -1;
+    count = graph_bfs(offsets,adjacency,best,levels,queue);
+    if (levels[queue[count-1]] <= ecc)
+      break;
+    root = best;
+    ecc = levels[queue[count-1]];
+  }
+  for (i = 0; i < count; ++ i)
+    levels[queue[i]] = -1;
+  return root;
+}
+
+void graph_ordering_rcm(int n, int* offsets, int* adjacency, int* perm)
+{
+  int* levels = (int*)malloc(sizeof(int)*n);
+  int* queue = (int*)malloc(sizeof(int)*n);
+  BOOL* numbered = (BOOL*)calloc(n,sizeof(BOOL));
+  int i,j,k,v,u,head,start,tmp;
+
+  for (i = 0; i < n; ++ i)
+    levels[i] = -1;
+  k = 0;
+  for (i = 0; i < n; ++ i)
+  {
+    if (numbered[i])
+      continue;
+    /* Cuthill-McKee numbering of the connected component of i */
+    v = graph_pseudo_peripheral(offsets,adjacency,i,levels,queue);
+    numbered[v] = TRUE;
+    head = k;
+    perm[k++] = v;
+    while (head < k)
+    {
+      v = perm[head++];
+      start = k;
+      for (j = offsets[v]; j < offsets[v+1]; ++ j)
+      {
+        u = adjacency[j];
+        if (!numbered[u])
+        {
+          numbered[u] = TRUE;
+          perm[k++] = u;
+        }
+      }
+      /* neighbours in order of increasing degree */
+      for (j = start + 1; j < k; ++ j)
+      {
+        tmp = perm[j];
+        for (u = j; u > start &&
+               graph_degree(offsets,perm[u-1]) > graph_degree(offsets,tmp);
+             -- u)
+          perm[u] = perm[u-1];
+        perm[u] = tmp;
+      }
+    }
+  }
+  /* reverse */
+  for (i = 0; i < n/2; ++ i)
+  {
+    tmp = perm[i];
+    perm[i] = perm[n-1-i];
+    perm[n-1-i] = tmp;
+  }
+  free(levels);
+  free(queue);
+  free(numbered);
+}
+
+
+/* states of the vertices of the quotient graph */
+#define AMD_VARIABLE 0          /* not eliminated yet */
+#define AMD_ELEMENT 1           /* eliminated, represents a clique */
+#define AMD_ABSORBED 2          /* element absorbed by another element */
+
+/* remove variable from the degree lists */
+static void amd_list_remove(int i, int* degree, int* head,
+                            int* next, int* prev)
+{
+  if (prev[i] != -1)
+    next[prev[i]] = next[i];
+  else
+    head[degree[i]] = next[i];
+  if (next[i] != -1)
+    prev[next[i]] = prev[i];
+}
+
+/* insert variable to the degree list */
+static void amd_list_insert(int i, int* degree, int* head,
+                            int* next, int* prev)
+{
+  next[i] = head[degree[i]];
+  prev[i] = -1;
+  if (head[degree[i]] != -1)
+    prev[head[degree[i]]] = i;
+  head[degree[i]] = i;
+}
+
+void graph_ordering_amd(int n, int* offsets, int* adjacency, int* perm)
+{
+  /* adjacent variables of the variable */
+  int_list* vars = (int_list*)calloc(n,sizeof(int_list));
+  /* adjacent elements of the variable */
+  int_list* elems = (int_list*)calloc(n,sizeof(int_list));
+  /* variables of the element */
+  int_list* element_vars = (int_list*)calloc(n,sizeof(int_list));
+  int* state = (int*)calloc(n,sizeof(int));
+  int* degree = (int*)malloc(sizeof(int)*n);
+  int* head = (int*)malloc(sizeof(int)*n);
+  int* next = (int*)malloc(sizeof(int)*n);
+  int* prev = (int*)malloc(sizeof(int)*n);
+  /* marks of the variables in the current pivot element */
+  int* marks = (int*)malloc(sizeof(int)*n);
+  /* |L_e \ L_p| for elements adjacent to the pivot element */
+  int* external = (int*)malloc(sizeof(int)*n);
+  int* external_marks = (int*)malloc(sizeof(int)*n);
+  int i,j,k,p,e,v,d,count,mindeg;
+  int_list* lp;
+
+  for (i = 0; i < n; ++ i)
+  {
+    head[i] = -1;
+    marks[i] = external_marks[i] = -1;
+  }
+  for (i = 0; i < n; ++ i)
+  {
+    for (j = offsets[i]; j < offsets[i+1]; ++ j)
+      int_list_push(&vars[i],adjacency[j]);
+    degree[i] = vars[i].count;
+    amd_list_insert(i,degree,head,next,prev);
+  }
+  mindeg = 0;
+  for (k = 0; k < n; ++ k)
+  {
+    /* pivot of the minimum approximate degree */
+    while (head[mindeg] == -1)
+      mindeg ++;
+    p = head[mindeg];
+    amd_list_remove(p,degree,head,next,prev);
+    perm[k] = p;
+    state[p] = AMD_ELEMENT;
+    marks[p] = k;
+
+    /* construct the new element L_p, absorbing adjacent elements */
+    lp = &element_vars[p];
+    for (j = 0; j < elems[p].count; ++ j)
+    {
+      e = elems[p].items[j];
+      if (state[e] != AMD_ELEMENT)
+        continue;
+      for (i = 0; i < element_vars[e].count; ++ i)
+      {
+        v = element_vars[e].items[i];
+        if (state[v] == AMD_VARIABLE && marks[v] != k)
+        {
+          marks[v] = k;
+          int_list_push(lp,v);
+        }
+      }
+      state[e] = AMD_ABSORBED;
+      int_list_free(&element_vars[e]);
+    }
+    for (j = 0; j < vars[p].count; ++ j)
+    {
+      v = vars[p].items[j];
+      if (state[v] == AMD_VARIABLE && marks[v] != k)
+      {
+        marks[v] = k;
+        int_list_push(lp,v);
+      }
+    }
+    int_list_free(&vars[p]);
+    int_list_free(&elems[p]);
+
+    /* |L_e \ L_p| for all elements adjacent to the variables of L_p */
+    for (i = 0; i < lp->count; ++ i)
+    {
+      v = lp->items[i];
+      for (j = 0; j < elems[v].count; ++ j)
+      {
+        e = elems[v].items[j];
+        if (state[e] != AMD_ELEMENT)
+          continue;
+        if (external_marks[e] != k)
+        {
+          external_marks[e] = k;
+          external[e] = element_vars[e].count;
+        }
+        external[e] --;
+      }
+    }
+
+    /* update variables of L_p */
+    for (i = 0; i < lp->count; ++ i)
+    {
+      v = lp->items[i];
+      amd_list_remove(v,degree,head,next,prev);
+      /*
+       * keep only alive elements not covered by L_p (covered are
+       * absorbed by p) and append p
+       */
+      d = lp->count - 1;
+      count = 0;
+      for (j = 0; j < elems[v].count; ++ j)
+      {
+        e = elems[v].items[j];
+        if (state[e] != AMD_ELEMENT)
+          continue;
+        if (external[e] == 0)
+        {
+          state[e] = AMD_ABSORBED;
+          int_list_free(&element_vars[e]);
+          continue;
+        }
+        d += external[e];
+        elems[v].items[count++] = e;
+      }
+      elems[v].count = count;
+      int_list_push(&elems[v],p);
+      /* variables of L_p are adjacent through p now */
+      count = 0;
+      for (j = 0; j < vars[v].count; ++ j)
+      {
+        e = vars[v].items[j];
+        if (state[e] == AMD_VARIABLE && marks[e] != k)
+          vars[v].items[count++] = e;
+      }
+      vars[v].count = count;
+      d += count;
+      /* degree can't exceed the number of remaining variables */
+      if (d > n - k - 2)
+        d = n - k - 2;
+      degree[v] = d;
+      amd_list_insert(v,degree,head,next,prev);
+      if (d < mindeg)
+        mindeg = d;
+    }
+  }
+
+  for (i = 0; i < n; ++ i)
+  {
+    int_list_free(&vars[i]);
+    int_list_free(&elems[i]);
+    int_list_free(&element_vars[i]);
+  }
+  free(vars);
+  free(elems);
+  free(element_vars);
+  free(state);
+  free(degree);
+  free(head);
+  free(next);
+  free(prev);
+  free(marks);
+  free(external);
+  free(external_marks);
+}
+
+long graph_cholesky_fill(int n, int* offsets, int* adjacency, int* perm)
+{
+  int* iperm = (int*)malloc(sizeof(int)*n);
+  int* parent = (int*)malloc(sizeof(int)*n);
+  int* ancestor = (int*)malloc(sizeof(int)*n);
+  int* marks = ancestor;
+  int i,j,k,next,old;
+  long fill = n;
+
+  for (k = 0; k < n; ++ k)
+    iperm[perm ? perm[k] : k] = k;
+  /* elimination tree */
+  for (k = 0; k < n; ++ k)
+  {
+    parent[k] = -1;
+    ancestor[k] = -1;
+    old = perm ? perm[k] : k;
+    for (j = offsets[old]; j < offsets[old+1]; ++ j)
+      for (i = iperm[adjacency[j]]; i != -1 && i < k; i = next)
+      {
+        next = ancestor[i];
+        ancestor[i] = k;
+        if (next == -1)
+          parent[i] = k;
+      }
+  }
+  /* count of the rows of L as the paths in the elimination tree */
+  for (k = 0; k < n; ++ k)
+    marks[k] = -1;
+  for (k = 0; k < n; ++ k)
+  {
+    marks[k] = k;
+    old = perm ? perm[k] : k;
+    for (j = offsets[old]; j < offsets[old+1]; ++ j)
+      for (i = iperm[adjacency[j]]; i < k && marks[i] != k; i = parent[i])
+      {
+        marks[i] = k;
+        fill ++;
+      }
+  }
+  free(iperm);
+  free(parent);
+  free(ancestor);
+  return fill;
+}
+
+int graph_bandwidth(int n, int* offsets, int* adjacency, int* perm)
+{
+  int* iperm = (int*)malloc(sizeof(int)*n);
+  int i,j,width = 0;
+  for (i = 0; i < n; ++ i)
+    iperm[perm ? perm[i] : i] = i;
+  for (i = 0; i < n; ++ i)
+    for (j = offsets[i]; j < offsets[i+1]; ++ j)
+      if (abs(iperm[i] - iperm[adjacency[j]]) > width)
+        width = abs(iperm[i] - iperm[adjacency[j]]);
+  free(iperm);
+  return width;
+}
@@ -0,0 +1,44 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#ifndef __GRAPH_ORDERING_H__
+#define __GRAPH_ORDERING_H__
+
+#include "defines.h"
+
+/*
+ * Orderings of the vertices of the undirected graph, used to reorder
+ * the sparse symmetric matrices.
+ * Graph is given in compressed form: neighbours of the vertex i are
+ * adjacency[offsets[i]..offsets[i+1]-1], without the vertex i itself.
+ * Resulting permutation perm lists vertices in the new order, i.e.
+ * perm[new index] = old index
+ */
+
+/*
+ * Reverse Cuthill-McKee ordering, reduces bandwidth of the matrix
+ * Every connected component starts from a pseudo-peripheral vertex
+ */
+void graph_ordering_rcm(int n, int* offsets, int* adjacency, int* perm);
+
+/*
+ * Approximate minimum degree ordering, reduces fill-in of the Cholesky
+ * decomposition. Uses quotient graph of the elimination with the
+ * approximate external degrees as in the AMD algorithm, but without
+ * supervariables detection
+ */
+void graph_ordering_amd(int n, int* offsets, int* adjacency, int* perm);
+
+/*
+ * Number of nonzeros in the Cholesky decomposition L of the matrix
+ * with the pattern of the graph, including diagonal, for the
+ * ordering perm. perm could be 0 for the original order
+ */
+long graph_cholesky_fill(int n, int* offsets, int* adjacency, int* perm);
+
+/*
+ * Bandwidth of the matrix with the pattern of the graph for the
+ * ordering perm, max |new(i) - new(j)| for all edges (i,j).
+ * perm could be 0 for the original order
+ */
+int graph_bandwidth(int n, int* offsets, int* adjacency, int* perm);
+
+#endif /* __GRAPH_ORDERING_H__ */
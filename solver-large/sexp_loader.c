@@ -91,6 +91,43 @@ static void process_solution(sexp_item* item, parse_data* data)
     data->task->modified_newton = TRUE;
   value = sexp_item_attribute(item,"max-newton-count");
   data->task->max_newton_count = sexp_item_inumber(value);
+  value = sexp_item_attribute(item,"threads");
+  if (value)
+    data->task->threads_count = sexp_item_inumber(value);
+  value = sexp_item_attribute(item,"element-batch");
+  if (value)
+    data->task->element_batch =
+      sexp_item_is_symbol_like(value,"YES") ||
+      sexp_item_is_symbol_like(value,"TRUE");
+  value = sexp_item_attribute(item,"adaptive-load-steps");
+  if (value)
+    data->task->adaptive_load_steps =
+      sexp_item_is_symbol_like(value,"YES") ||
+      sexp_item_is_symbol_like(value,"TRUE");
+  value = sexp_item_attribute(item,"desired-newton-count");
+  if (value)
+    data->task->desired_newton_count = sexp_item_inumber(value);
+  value = sexp_item_attribute(item,"tangent-refresh-ratio");
+  if (value)
+    data->task->tangent_refresh_ratio = sexp_item_fnumber(value);
+  value = sexp_item_attribute(item,"tangent-refresh-max");
+  if (value)
+    data->task->tangent_refresh_max = sexp_item_inumber(value);
+  value = sexp_item_attribute(item,"bfgs");
+  if (value)
+    data->task->bfgs =
+      sexp_item_is_symbol_like(value,"YES") ||
+      sexp_item_is_symbol_like(value,"TRUE");
+  value = sexp_item_attribute(item,"inexact-newton");
+  if (value)
+    data->task->inexact_newton =
+      sexp_item_is_symbol_like(value,"YES") ||
+      sexp_item_is_symbol_like(value,"TRUE");
+  value = sexp_item_attribute(item,"predictor");
+  if (value)
+    data->task->predictor =
+      sexp_item_is_symbol_like(value,"YES") ||
+      sexp_item_is_symbol_like(value,"TRUE");
 }
 
 static void process_slae_solver(sexp_item* item, parse_data* data)
@@ -113,9 +150,16 @@ static void process_slae_solver(sexp_item* item, parse_data* data)
       data->task->solver_max_iter = value ? sexp_item_inumber(value) :
         MAX_ITERATIVE_ITERATIONS;
     }
-    else if (sexp_item_is_symbol_like(value,"PCG_ILU"))
+    else if (sexp_item_is_symbol_like(value,"PCG_ILU") ||
+             sexp_item_is_symbol_like(value,"PCG_BLOCK_JACOBI") ||
+             sexp_item_is_symbol_like(value,"PCG_IC0") ||
+             sexp_item_is_symbol_like(value,"PCG_MULTIGRID"))
     {
-      data->task->solver_type = PCG_ILU;
+      data->task->solver_type =
+        sexp_item_is_symbol_like(value,"PCG_ILU") ? PCG_ILU :
+        sexp_item_is_symbol_like(value,"PCG_IC0") ? PCG_IC0 :
+        sexp_item_is_symbol_like(value,"PCG_MULTIGRID") ? PCG_MULTIGRID :
+        PCG_BLOCK_JACOBI;
       value = sexp_item_attribute(item,"tolerance");
       if (value)
         data->task->solver_tolerance = sexp_item_fnumber(value);
@@ -123,15 +167,68 @@ static void process_slae_solver(sexp_item* item, parse_data* data)
       data->task->solver_max_iter = value ? sexp_item_inumber(value) :
         MAX_ITERATIVE_ITERATIONS;
     } 
+    else if (sexp_item_is_symbol_like(value,"MATRIX_FREE"))
+    {
+      data->task->solver_type = MATRIX_FREE;
+      value = sexp_item_attribute(item,"tolerance");
+      if (value)
+        data->task->solver_tolerance = sexp_item_fnumber(value);
+      value = sexp_item_attribute(item,"max-iterations");
+      data->task->solver_max_iter = value ? sexp_item_inumber(value) :
+        MAX_ITERATIVE_ITERATIONS;
+    }
     else if (sexp_item_is_symbol_like(value,"CHOLESKY"))
     {
       data->task->solver_type = CHOLESKY;
+      value = sexp_item_attribute(item,"precision");
+      if (value)
+        data->task->mixed_precision = sexp_item_is_symbol_like(value,"MIXED");
+      value = sexp_item_attribute(item,"fallback");
+      if (value)
+        data->task->mixed_precision_fallback =
+          sexp_item_is_symbol_like(value,"YES") ||
+          sexp_item_is_symbol_like(value,"TRUE");
+      /* tolerance and iterations of the iterative refinement */
+      value = sexp_item_attribute(item,"tolerance");
+      if (value)
+        data->task->solver_tolerance = sexp_item_fnumber(value);
+      value = sexp_item_attribute(item,"max-iterations");
+      data->task->solver_max_iter = value ? sexp_item_inumber(value) :
+        MAX_REFINEMENT_ITERATIONS;
     } 
     else
     {
       printf("unknown solver type '%s'\n",sexp_item_symbol(value));
     }
   }
+  /*
+   * by default store only upper triangle of the stiffness matrix,
+   * except for the PCG_ILU solver requiring full matrix
+   */
+  data->task->symmetric_storage = data->task->solver_type != PCG_ILU;
+  value = sexp_item_attribute(item,"symmetric-storage");
+  if (value)
+    data->task->symmetric_storage =
+      sexp_item_is_symbol_like(value,"YES") ||
+      sexp_item_is_symbol_like(value,"TRUE");
+  /*
+   * by default reduce fill-in for Cholesky decomposition and
+   * bandwidth for iterative solvers
+   */
+  data->task->ordering =
+    data->task->solver_type == CHOLESKY ? ORDERING_AMD : ORDERING_RCM;
+  value = sexp_item_attribute(item,"ordering");
+  if (value)
+  {
+    if (sexp_item_is_symbol_like(value,"NONE"))
+      data->task->ordering = ORDERING_NONE;
+    else if (sexp_item_is_symbol_like(value,"RCM"))
+      data->task->ordering = ORDERING_RCM;
+    else if (sexp_item_is_symbol_like(value,"AMD"))
+      data->task->ordering = ORDERING_AMD;
+    else
+      printf("unknown ordering '%s'\n",sexp_item_symbol(value));
+  }
 }
 
 
@@ -172,13 +269,10 @@ static void process_nodes(sexp_item* item, parse_data* data)
   int i = 0;
   sexp_item* next = sexp_item_cdr(item);
   count = sexp_item_length(item) - 1;
-  data->nodes->nodes_count = count;
   /* allocate storage for nodes */
-  data->nodes->nodes =
-    (real**)malloc(data->nodes->nodes_count*sizeof(real*));
+  nodes_array_storage_alloc(data->nodes,count);
   for (; i < data->nodes->nodes_count; ++ i)
   {
-    data->nodes->nodes[i] = (real*)malloc(MAX_DOF*sizeof(real));
     item = sexp_item_car(next);
     assert(sexp_item_length(item) == 3);
     data->nodes->nodes[i][0] = sexp_item_fnumber(sexp_item_nth(item,0));
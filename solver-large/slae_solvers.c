@@ -0,0 +1,895 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "slae_solvers.h"
+#include "dense_matrix.h"
+
+
+void slae_sym_mv(sp_matrix_ptr mtx, real* x, real* y)
+{
+  int col,j,row;
+  real value, xcol, sum;
+  memset(y,0,sizeof(real)*mtx->rows_count);
+  for (col = 0; col < mtx->cols_count; ++ col)
+  {
+    xcol = x[col];
+    sum = 0;
+    for (j = 0; j <= mtx->storage[col].last_index; ++ j)
+    {
+      row = mtx->storage[col].indexes[j];
+      value = mtx->storage[col].values[j];
+      /* upper triangle element (row,col) */
+      y[row] += value*xcol;
+      /* and symmetric lower triangle element (col,row) */
+      if (row != col)
+        sum += value*x[row];
+    }
+    y[col] += sum;
+  }
+}
+
+void slae_mv(sp_matrix_ptr mtx, real* x, real* y)
+{
+  int col,j;
+  real xcol;
+  memset(y,0,sizeof(real)*mtx->rows_count);
+  for (col = 0; col < mtx->cols_count; ++ col)
+  {
+    xcol = x[col];
+    for (j = 0; j <= mtx->storage[col].last_index; ++ j)
+      y[mtx->storage[col].indexes[j]] += mtx->storage[col].values[j]*xcol;
+  }
+}
+
+void slae_sym_mv_operator(void* data, real* x, real* y)
+{
+  slae_sym_mv((sp_matrix_ptr)data,x,y);
+}
+
+void slae_mv_operator(void* data, real* x, real* y)
+{
+  slae_mv((sp_matrix_ptr)data,x,y);
+}
+
+void slae_masked_mv(slae_masked_matrix_ptr A, real* x, real* y)
+{
+  int i,j;
+  sp_matrix_ptr mtx = A->mtx;
+  real* x_free = x;
+  if (A->mask)
+  {
+    /* exclude columns of constrained d.o.f. */
+    x_free = A->work;
+    for (i = 0; i < mtx->rows_count; ++ i)
+      x_free[i] = A->mask[i] ? 0 : x[i];
+  }
+  if (A->symmetric)
+    slae_sym_mv(mtx,x_free,y);
+  else
+    slae_mv(mtx,x_free,y);
+  if (!A->mask)
+    return;
+  /* rows of constrained d.o.f. contain only diagonal elements */
+  for (i = 0; i < mtx->rows_count; ++ i)
+    if (A->mask[i])
+    {
+      y[i] = 0;
+      for (j = 0; j <= mtx->storage[i].last_index; ++ j)
+        if (mtx->storage[i].indexes[j] == i)
+          y[i] = mtx->storage[i].values[j]*x[i];
+    }
+}
+
+void slae_masked_mv_operator(void* data, real* x, real* y)
+{
+  slae_masked_mv((slae_masked_matrix_ptr)data,x,y);
+}
+
+
+void slae_jacobi_operator(void* data, real* x, real* y)
+{
+  slae_jacobi_ptr M = (slae_jacobi_ptr)data;
+  int i;
+  for (i = 0; i < M->size; ++ i)
+    y[i] = x[i]/M->diag[i];
+}
+
+/*
+ * Inverse of the symmetric positive definite dense matrix n x n
+ * in place by Gauss-Jordan elimination without pivoting
+ */
+static void slae_dense_inverse(real* a, int n)
+{
+  int i,j,k;
+  real pivot,factor;
+  for (k = 0; k < n; ++ k)
+  {
+    pivot = 1/a[k*n + k];
+    a[k*n + k] = 1;
+    for (j = 0; j < n; ++ j)
+      a[k*n + j] *= pivot;
+    for (i = 0; i < n; ++ i)
+      if (i != k)
+      {
+        factor = a[i*n + k];
+        a[i*n + k] = 0;
+        for (j = 0; j < n; ++ j)
+          a[i*n + j] -= factor*a[k*n + j];
+      }
+  }
+}
+
+void slae_block_jacobi_create(slae_block_jacobi_ptr self,
+                              sp_matrix_ptr mtx,
+                              BOOL* mask,
+                              int block)
+{
+  int n = mtx->rows_count;
+  int col,j,row,first;
+  real* a;
+  self->size = n;
+  self->block = block;
+  self->inverses = (real*)calloc(n*block,sizeof(real));
+  /* gather diagonal blocks, symmetric by both triangles */
+  for (col = 0; col < n; ++ col)
+  {
+    first = col - col % block;
+    a = self->inverses + first*block;
+    for (j = 0; j <= mtx->storage[col].last_index; ++ j)
+    {
+      row = mtx->storage[col].indexes[j];
+      if (row < first || row >= first + block ||
+          (row != col && mask && (mask[row] || mask[col])))
+        continue;
+      a[(row - first)*block + col - first] = mtx->storage[col].values[j];
+      a[(col - first)*block + row - first] = mtx->storage[col].values[j];
+    }
+  }
+  for (first = 0; first < n; first += block)
+    slae_dense_inverse(self->inverses + first*block,block);
+}
+
+void slae_block_jacobi_operator(void* data, real* x, real* y)
+{
+  slae_block_jacobi_ptr M = (slae_block_jacobi_ptr)data;
+  int first,i,j;
+  int block = M->block;
+  real* a;
+  real sum;
+  for (first = 0; first < M->size; first += block)
+  {
+    a = M->inverses + first*block;
+    for (i = 0; i < block; ++ i)
+    {
+      sum = 0;
+      for (j = 0; j < block; ++ j)
+        sum += a[i*block + j]*x[first + j];
+      y[first + i] = sum;
+    }
+  }
+}
+
+void slae_block_jacobi_free(slae_block_jacobi_ptr self)
+{
+  free(self->inverses);
+  memset(self,0,sizeof(slae_block_jacobi));
+}
+
+void slae_ic0_symbolic(slae_ic0_ptr self, sp_matrix_ptr mtx)
+{
+  int n = mtx->rows_count;
+  int col,j,k;
+  self->size = n;
+  self->shift = 0;
+  self->factorized = FALSE;
+  self->offsets = (int*)malloc(sizeof(int)*(n+1));
+  self->offsets[0] = 0;
+  for (col = 0; col < n; ++ col)
+  {
+    k = 0;
+    for (j = 0; j <= mtx->storage[col].last_index; ++ j)
+      if (mtx->storage[col].indexes[j] <= col)
+        k ++;
+    self->offsets[col+1] = self->offsets[col] + k;
+  }
+  self->rows = (int*)malloc(sizeof(int)*self->offsets[n]);
+  self->values = (real*)malloc(sizeof(real)*self->offsets[n]);
+  self->x = (real*)calloc(n,sizeof(real));
+  for (col = 0, k = 0; col < n; ++ col)
+    for (j = 0; j <= mtx->storage[col].last_index; ++ j)
+      if (mtx->storage[col].indexes[j] <= col)
+        self->rows[k++] = mtx->storage[col].indexes[j];
+}
+
+/*
+ * Numeric IC(0) decomposition with the diagonal of the matrix
+ * multiplied by 1 + self->shift. Column of U is computed in the
+ * workspace x by the left-looking algorithm:
+ * U(i,k) = (A(i,k) - sum_j U(j,i)*U(j,k))/U(i,i)
+ * Returns FALSE on breakdown
+ */
+static BOOL slae_ic0_numeric_shifted(slae_ic0_ptr self,
+                                     sp_matrix_ptr mtx,
+                                     BOOL* mask)
+{
+  int n = self->size;
+  int i,j,k,p,q,diag;
+  real sum;
+  real* x = self->x;
+  BOOL result = TRUE;
+  for (k = 0; k < n && result; ++ k)
+  {
+    /* scatter upper part of the column k of A to x */
+    for (j = 0; j <= mtx->storage[k].last_index; ++ j)
+    {
+      i = mtx->storage[k].indexes[j];
+      if (i == k)
+        x[i] = mtx->storage[k].values[j]*(1 + self->shift);
+      else if (i < k && !(mask && (mask[i] || mask[k])))
+        x[i] = mtx->storage[k].values[j];
+    }
+    diag = self->offsets[k+1] - 1;
+    /* off-diagonal elements in ascending order of rows */
+    for (p = self->offsets[k]; p < diag; ++ p)
+    {
+      i = self->rows[p];
+      sum = x[i];
+      /* x contains U(j,k) for j < i, zeros outside of the pattern */
+      for (q = self->offsets[i]; q < self->offsets[i+1] - 1; ++ q)
+        sum -= self->values[q]*x[self->rows[q]];
+      x[i] = sum/self->values[self->offsets[i+1] - 1];
+      self->values[p] = x[i];
+    }
+    sum = x[k];
+    for (p = self->offsets[k]; p < diag; ++ p)
+      sum -= self->values[p]*self->values[p];
+    if (sum <= 0)
+      result = FALSE;
+    else
+      self->values[diag] = sqrt(sum);
+    /* clear workspace */
+    for (p = self->offsets[k]; p <= diag; ++ p)
+      x[self->rows[p]] = 0;
+  }
+  return result;
+}
+
+BOOL slae_ic0_numeric(slae_ic0_ptr self, sp_matrix_ptr mtx, BOOL* mask)
+{
+  int attempt;
+  self->shift = 0;
+  self->factorized = FALSE;
+  /* shifts 0, 1e-3, 2e-3, 4e-3 ... up to the diagonal dominance */
+  for (attempt = 0; attempt < 20; ++ attempt)
+  {
+    if (slae_ic0_numeric_shifted(self,mtx,mask))
+    {
+      self->factorized = TRUE;
+      return TRUE;
+    }
+    self->shift = self->shift ? 2*self->shift : 1e-3;
+  }
+  return FALSE;
+}
+
+void slae_ic0_operator(void* data, real* x, real* y)
+{
+  slae_ic0_ptr M = (slae_ic0_ptr)data;
+  int n = M->size;
+  int j,p,diag;
+  real sum;
+  /* U'*z = x */
+  for (j = 0; j < n; ++ j)
+  {
+    diag = M->offsets[j+1] - 1;
+    sum = x[j];
+    for (p = M->offsets[j]; p < diag; ++ p)
+      sum -= M->values[p]*y[M->rows[p]];
+    y[j] = sum/M->values[diag];
+  }
+  /* U*y = z */
+  for (j = n - 1; j >= 0; -- j)
+  {
+    diag = M->offsets[j+1] - 1;
+    y[j] /= M->values[diag];
+    for (p = M->offsets[j]; p < diag; ++ p)
+      y[M->rows[p]] -= M->values[p]*y[j];
+  }
+}
+
+void slae_ic0_free(slae_ic0_ptr self)
+{
+  free(self->offsets);
+  free(self->rows);
+  free(self->values);
+  free(self->x);
+  memset(self,0,sizeof(slae_ic0));
+}
+
+/*
+ * Element (row,col) of the upper triangle of the coarse matrix to which
+ * the fine matrix element A(i,j), i <= j, adds P(i,I)*A(i,j)*P(j,J).
+ * Returns the multiplier of the contribution, 0 if there is none
+ */
+static int slae_twogrid_target(int i, int j, int I, int J,
+                               int* row, int* col)
+{
+  *row = I < J ? I : J;
+  *col = I < J ? J : I;
+  if (I < J)
+    return 1;
+  /* the fine diagonal adds to both triangles by the pairs (I,J),(J,I) */
+  if (i == j)
+    return I == J;
+  /* A(i,j) adds both to A_c(I,J) and A_c(J,I) */
+  return I > J ? 1 : 2;
+}
+
+/* position of the element (row,col) in the column col of mtx */
+static int slae_twogrid_position(sp_matrix_ptr mtx, int row, int col)
+{
+  int k;
+  for (k = 0; k <= mtx->storage[col].last_index; ++ k)
+    if (mtx->storage[col].indexes[k] == row)
+      break;
+  assert(k <= mtx->storage[col].last_index);
+  return k;
+}
+
+void slae_twogrid_init(slae_twogrid_ptr self,
+                       slae_masked_matrix_ptr A,
+                       int coarse_size,
+                       int* prolong_indexes,
+                       real* prolong_weights,
+                       int block,
+                       real omega)
+{
+  int i,j,k,p,q,row,col,last,offset;
+  int n = A->mtx->rows_count;
+  int nonzeros = 0;
+  sp_matrix_ptr mtx = A->mtx;
+  BOOL* mask = A->mask;
+  int* slots;
+  memset(self,0,sizeof(slae_twogrid));
+  self->A = *A;
+  self->A.work = (real*)malloc(sizeof(real)*n);
+  self->size = n;
+  self->coarse_size = coarse_size;
+  self->prolong_indexes = prolong_indexes;
+  self->prolong_weights = prolong_weights;
+  self->block = block;
+  self->omega = omega;
+  self->work = (real*)malloc(sizeof(real)*(2*n + coarse_size));
+  /* coarse d.o.f. not used by any fine one */
+  self->coarse_mask = (BOOL*)malloc(sizeof(BOOL)*coarse_size);
+  for (i = 0; i < coarse_size; ++ i)
+    self->coarse_mask[i] = TRUE;
+  for (i = 0; i < n*SLAE_TWOGRID_PROLONG; ++ i)
+    if (prolong_indexes[i] != -1)
+      self->coarse_mask[prolong_indexes[i]] = FALSE;
+
+  /* pattern of the coarse matrix: diagonal and all contributions */
+  sp_matrix_init(&self->coarse,coarse_size,coarse_size,32,CCS);
+  for (i = 0; i < coarse_size; ++ i)
+    sp_matrix_element_add(&self->coarse,i,i,0);
+  for (j = 0; j < n; ++ j)
+  {
+    nonzeros += mtx->storage[j].last_index + 1;
+    for (k = 0; k <= mtx->storage[j].last_index; ++ k)
+    {
+      i = mtx->storage[j].indexes[k];
+      if (i > j || (i != j && mask && (mask[i] || mask[j])))
+        continue;
+      for (p = 0; p < SLAE_TWOGRID_PROLONG; ++ p)
+        for (q = 0; q < SLAE_TWOGRID_PROLONG; ++ q)
+          if (prolong_indexes[i*SLAE_TWOGRID_PROLONG + p] != -1 &&
+              prolong_indexes[j*SLAE_TWOGRID_PROLONG + q] != -1 &&
+              slae_twogrid_target(i,j,
+                                  prolong_indexes[i*SLAE_TWOGRID_PROLONG + p],
+                                  prolong_indexes[j*SLAE_TWOGRID_PROLONG + q],
+                                  &row,&col))
+            sp_matrix_element_add(&self->coarse,row,col,0);
+    }
+  }
+  
+  /* positions of the contributions, after all insertions */
+  self->coarse_diag = (int*)malloc(sizeof(int)*coarse_size);
+  self->coarse_slots = (int*)malloc(sizeof(int)*nonzeros*
+                                    SLAE_TWOGRID_PROLONG*
+                                    SLAE_TWOGRID_PROLONG);
+  for (i = 0; i < coarse_size; ++ i)
+    self->coarse_diag[i] = slae_twogrid_position(&self->coarse,i,i);
+  offset = 0;
+  for (j = 0; j < n; ++ j)
+  {
+    last = mtx->storage[j].last_index;
+    for (k = 0; k <= last; ++ k, ++ offset)
+    {
+      i = mtx->storage[j].indexes[k];
+      slots = self->coarse_slots +
+        offset*SLAE_TWOGRID_PROLONG*SLAE_TWOGRID_PROLONG;
+      for (p = 0; p < SLAE_TWOGRID_PROLONG*SLAE_TWOGRID_PROLONG; ++ p)
+        slots[p] = -1;
+      if (i > j || (i != j && mask && (mask[i] || mask[j])))
+        continue;
+      for (p = 0; p < SLAE_TWOGRID_PROLONG; ++ p)
+        for (q = 0; q < SLAE_TWOGRID_PROLONG; ++ q)
+          if (prolong_indexes[i*SLAE_TWOGRID_PROLONG + p] != -1 &&
+              prolong_indexes[j*SLAE_TWOGRID_PROLONG + q] != -1 &&
+              slae_twogrid_target(i,j,
+                                  prolong_indexes[i*SLAE_TWOGRID_PROLONG + p],
+                                  prolong_indexes[j*SLAE_TWOGRID_PROLONG + q],
+                                  &row,&col))
+            slots[p*SLAE_TWOGRID_PROLONG + q] =
+              slae_twogrid_position(&self->coarse,row,col);
+    }
+  }
+}
+
+BOOL slae_twogrid_numeric(slae_twogrid_ptr self)
+{
+  int i,j,k,p,q,I,J,row,col,factor,offset;
+  real value;
+  sp_matrix_ptr mtx = self->A.mtx;
+  BOOL* mask = self->A.mask;
+  int* indexes = self->prolong_indexes;
+  real* weights = self->prolong_weights;
+  int* slots;
+
+  self->factorized = FALSE;
+  for (j = 0; j < self->coarse_size; ++ j)
+    memset(self->coarse.storage[j].values,0,
+           sizeof(real)*(self->coarse.storage[j].last_index + 1));
+  /*
+   * A_c = P'*A*P by the upper triangle of A: the element A(i,j), i < j
+   * adds v = P(i,I)*A(i,j)*P(j,J) both to A_c(I,J) and A_c(J,I).
+   * Positions in the coarse matrix are known from the initialization
+   */
+  offset = 0;
+  for (j = 0; j < self->size; ++ j)
+    for (k = 0; k <= mtx->storage[j].last_index; ++ k, ++ offset)
+    {
+      i = mtx->storage[j].indexes[k];
+      if (i > j || (i != j && mask && (mask[i] || mask[j])))
+        continue;
+      slots = self->coarse_slots +
+        offset*SLAE_TWOGRID_PROLONG*SLAE_TWOGRID_PROLONG;
+      for (p = 0; p < SLAE_TWOGRID_PROLONG; ++ p)
+        for (q = 0; q < SLAE_TWOGRID_PROLONG; ++ q)
+        {
+          if (slots[p*SLAE_TWOGRID_PROLONG + q] == -1)
+            continue;
+          I = indexes[i*SLAE_TWOGRID_PROLONG + p];
+          J = indexes[j*SLAE_TWOGRID_PROLONG + q];
+          factor = slae_twogrid_target(i,j,I,J,&row,&col);
+          value = weights[i*SLAE_TWOGRID_PROLONG + p]*
+            mtx->storage[j].values[k]*weights[j*SLAE_TWOGRID_PROLONG + q];
+          self->coarse.storage[col].values[slots[p*SLAE_TWOGRID_PROLONG + q]]
+            += factor*value;
+        }
+    }
+  for (I = 0; I < self->coarse_size; ++ I)
+    if (self->coarse_mask[I])
+      self->coarse.storage[I].values[self->coarse_diag[I]] += 1.0;
+  if (!self->coarse_chol.size)
+    slae_cholesky_symbolic(&self->coarse_chol,&self->coarse);
+  if (!slae_cholesky_numeric(&self->coarse_chol,&self->coarse,0))
+    return FALSE;
+  slae_block_jacobi_free(&self->smoother);
+  slae_block_jacobi_create(&self->smoother,mtx,mask,self->block);
+  self->factorized = TRUE;
+  return TRUE;
+}
+
+void slae_twogrid_operator(void* data, real* x, real* y)
+{
+  slae_twogrid_ptr M = (slae_twogrid_ptr)data;
+  int n = M->size;
+  int i,p;
+  real* r = M->work;
+  real* z = M->work + n;
+  real* coarse = M->work + 2*n;
+
+  /* pre-smoothing from zero: y = omega*B^-1*x */
+  slae_block_jacobi_operator(&M->smoother,x,y);
+  for (i = 0; i < n; ++ i)
+    y[i] *= M->omega;
+  /* restriction of the residual r = x - A*y to the coarse level */
+  slae_masked_mv(&M->A,y,r);
+  memset(coarse,0,sizeof(real)*M->coarse_size);
+  for (i = 0; i < n; ++ i)
+    for (p = i*SLAE_TWOGRID_PROLONG; p < (i+1)*SLAE_TWOGRID_PROLONG; ++ p)
+      if (M->prolong_indexes[p] != -1)
+        coarse[M->prolong_indexes[p]] += M->prolong_weights[p]*(x[i] - r[i]);
+  /* coarse correction y += P*A_c^-1*P'*r */
+  slae_cholesky_solve(&M->coarse_chol,coarse,coarse);
+  for (i = 0; i < n; ++ i)
+    for (p = i*SLAE_TWOGRID_PROLONG; p < (i+1)*SLAE_TWOGRID_PROLONG; ++ p)
+      if (M->prolong_indexes[p] != -1)
+        y[i] += M->prolong_weights[p]*coarse[M->prolong_indexes[p]];
+  /* post-smoothing y += omega*B^-1*(x - A*y) */
+  slae_masked_mv(&M->A,y,r);
+  for (i = 0; i < n; ++ i)
+    r[i] = x[i] - r[i];
+  slae_block_jacobi_operator(&M->smoother,r,z);
+  for (i = 0; i < n; ++ i)
+    y[i] += M->omega*z[i];
+}
+
+void slae_twogrid_free(slae_twogrid_ptr self)
+{
+  free(self->A.work);
+  free(self->prolong_indexes);
+  free(self->prolong_weights);
+  if (self->coarse.storage)
+    sp_matrix_free(&self->coarse);
+  free(self->coarse_mask);
+  free(self->coarse_slots);
+  free(self->coarse_diag);
+  slae_cholesky_free(&self->coarse_chol);
+  slae_block_jacobi_free(&self->smoother);
+  free(self->work);
+  memset(self,0,sizeof(slae_twogrid));
+}
+
+
+BOOL slae_solve_cg(slae_operator_t A,
+                   void* data,
+                   int size,
+                   real* b,
+                   real* x,
+                   int* max_iter,
+                   real* tolerance)
+{
+  return slae_solve_pcg(A,data,0,0,size,b,x,max_iter,tolerance);
+}
+
+BOOL slae_solve_pcg(slae_operator_t A,
+                    void* data,
+                    slae_operator_t M,
+                    void* mdata,
+                    int size,
+                    real* b,
+                    real* x,
+                    int* max_iter,
+                    real* tolerance)
+{
+  int i,iter;
+  real alpha,beta,rz,rz_new,rr,bnorm;
+  BOOL converged;
+  /* residual, preconditioned residual, search direction and A*p vectors */
+  real* r = (real*)malloc(sizeof(real)*size);
+  real* z = M ? (real*)malloc(sizeof(real)*size) : r;
+  real* p = (real*)malloc(sizeof(real)*size);
+  real* q = (real*)malloc(sizeof(real)*size);
+
+  bnorm = vector_norm(b,size);
+  if (bnorm == 0)
+    bnorm = 1;
+  /* r = b - A*x, z = M^-1*r, p = z */
+  A(data,x,q);
+  for (i = 0; i < size; ++ i)
+    r[i] = b[i] - q[i];
+  if (M)
+    M(mdata,r,z);
+  memcpy(p,z,sizeof(real)*size);
+  rr = cdot(r,r,size);
+  rz = M ? cdot(r,z,size) : rr;
+  for (iter = 0;
+       iter < *max_iter && sqrt(rr)/bnorm > *tolerance;
+       ++ iter)
+  {
+    A(data,p,q);
+    alpha = rz/cdot(p,q,size);
+    for (i = 0; i < size; ++ i)
+    {
+      x[i] += alpha*p[i];
+      r[i] -= alpha*q[i];
+    }
+    rr = cdot(r,r,size);
+    if (M)
+    {
+      M(mdata,r,z);
+      rz_new = cdot(r,z,size);
+    }
+    else
+      rz_new = rr;
+    beta = rz_new/rz;
+    rz = rz_new;
+    for (i = 0; i < size; ++ i)
+      p[i] = z[i] + beta*p[i];
+  }
+  converged = sqrt(rr)/bnorm <= *tolerance;
+  *max_iter = iter;
+  *tolerance = sqrt(rr)/bnorm;
+  
+  free(r);
+  if (M)
+    free(z);
+  free(p);
+  free(q);
+  return converged;
+}
+
+
+/*
+ * Find the pattern of the row k of L, which is the set of nodes of the
+ * elimination tree reachable from the nonzeros of the column k of
+ * upper triangle of A. The pattern is returned in stack[top..size-1]
+ * in topological order. marks shall not contain k on input
+ */
+static int slae_cholesky_ereach(slae_cholesky_ptr self,
+                                sp_matrix_ptr mtx,
+                                int k,
+                                int* stack,
+                                int* marks)
+{
+  int top = self->size;
+  int j,i,len;
+  marks[k] = k;
+  for (j = 0; j <= mtx->storage[k].last_index; ++ j)
+  {
+    i = mtx->storage[k].indexes[j];
+    if (i > k)
+      continue;
+    /* walk up the elimination tree until marked node */
+    for (len = 0; marks[i] != k; i = self->parent[i])
+    {
+      stack[len++] = i;
+      marks[i] = k;
+    }
+    /* push the path to the output stack */
+    while (len > 0)
+      stack[--top] = stack[--len];
+  }
+  return top;
+}
+
+void slae_cholesky_symbolic(slae_cholesky_ptr self, sp_matrix_ptr mtx)
+{
+  int n = mtx->rows_count;
+  int i,j,k,next,top;
+  int* ancestor;
+  int* stack;
+  int* marks;
+  int* counts;
+
+  self->size = n;
+  self->factorized = FALSE;
+  self->parent = (int*)malloc(sizeof(int)*n);
+  self->offsets = (int*)malloc(sizeof(int)*(n+1));
+  self->work = (int*)malloc(sizeof(int)*3*n);
+  self->x = (real*)malloc(sizeof(real)*n);
+  stack = self->work;
+  marks = self->work + n;
+  ancestor = counts = self->work + 2*n;
+  
+  /* elimination tree using path compression by ancestors */
+  for (k = 0; k < n; ++ k)
+  {
+    self->parent[k] = -1;
+    ancestor[k] = -1;
+    for (j = 0; j <= mtx->storage[k].last_index; ++ j)
+      for (i = mtx->storage[k].indexes[j]; i != -1 && i < k; i = next)
+      {
+        next = ancestor[i];
+        ancestor[i] = k;
+        if (next == -1)
+          self->parent[i] = k;
+      }
+  }
+  /* column counts of L, as number of rows having element in column */
+  for (k = 0; k < n; ++ k)
+  {
+    marks[k] = -1;
+    counts[k] = 1;              /* diagonal */
+  }
+  for (k = 0; k < n; ++ k)
+    for (top = slae_cholesky_ereach(self,mtx,k,stack,marks); top < n; ++ top)
+      counts[stack[top]]++;
+  self->offsets[0] = 0;
+  for (k = 0; k < n; ++ k)
+    self->offsets[k+1] = self->offsets[k] + counts[k];
+  self->rows = (int*)malloc(sizeof(int)*self->offsets[n]);
+  self->values = (real*)malloc(sizeof(real)*self->offsets[n]);
+  self->values_single = (float*)0;
+}
+
+BOOL slae_cholesky_numeric(slae_cholesky_ptr self,
+                           sp_matrix_ptr mtx,
+                           BOOL* mask)
+{
+  int n = self->size;
+  int i,j,k,p,top;
+  real d,lki;
+  real* x = self->x;
+  real* values = self->values;
+  float* values_single = self->values_single;
+  int* stack = self->work;
+  int* marks = self->work + n;
+  int* next = self->work + 2*n;   /* next free position in columns of L */
+
+  self->factorized = FALSE;
+  for (k = 0; k < n; ++ k)
+  {
+    marks[k] = -1;
+    next[k] = self->offsets[k];
+    x[k] = 0;
+  }
+  /*
+   * up-looking algorithm, compute L row by row. In single precision
+   * the row is accumulated in x in precision of real, and every value
+   * of L is rounded before it is used further
+   */
+  for (k = 0; k < n; ++ k)
+  {
+    top = slae_cholesky_ereach(self,mtx,k,stack,marks);
+    /* scatter upper part of the column k of A to x */
+    for (j = 0; j <= mtx->storage[k].last_index; ++ j)
+    {
+      i = mtx->storage[k].indexes[j];
+      if (i == k || (i < k && !(mask && (mask[i] || mask[k]))))
+        x[i] += mtx->storage[k].values[j];
+    }
+    d = x[k];
+    x[k] = 0;
+    /* triangular solve L(0:k-1,0:k-1) * l = A(0:k-1,k) */
+    for (; top < n; ++ top)
+    {
+      i = stack[top];
+      if (values_single)
+      {
+        lki = (float)(x[i]/values_single[self->offsets[i]]);
+        for (p = self->offsets[i] + 1; p < next[i]; ++ p)
+          x[self->rows[p]] -= values_single[p]*lki;
+      }
+      else
+      {
+        lki = x[i]/values[self->offsets[i]];
+        for (p = self->offsets[i] + 1; p < next[i]; ++ p)
+          x[self->rows[p]] -= values[p]*lki;
+      }
+      x[i] = 0;
+      d -= lki*lki;
+      p = next[i]++;
+      self->rows[p] = k;
+      if (values_single)
+        values_single[p] = (float)lki;
+      else
+        values[p] = lki;
+    }
+    if (d <= 0)
+      return FALSE;
+    p = next[k]++;
+    self->rows[p] = k;
+    if (values_single)
+      values_single[p] = (float)sqrt(d);
+    else
+      values[p] = sqrt(d);
+  }
+  self->factorized = TRUE;
+  return TRUE;
+}
+
+void slae_cholesky_single(slae_cholesky_ptr self, BOOL single)
+{
+  int nonzeros = self->offsets[self->size];
+  if (single == (self->values_single != 0))
+    return;
+  free(self->values);
+  free(self->values_single);
+  self->values = (real*)0;
+  self->values_single = (float*)0;
+  if (single)
+    self->values_single = (float*)malloc(sizeof(float)*nonzeros);
+  else
+    self->values = (real*)malloc(sizeof(real)*nonzeros);
+  self->factorized = FALSE;
+}
+
+void slae_cholesky_solve(slae_cholesky_ptr self, real* b, real* x)
+{
+  int n = self->size;
+  int j,p;
+  real* values = self->values;
+  float* values_single = self->values_single;
+  if (x != b)
+    memcpy(x,b,sizeof(real)*n);
+  if (values_single)
+  {
+    /* the same as below with values of L in single precision */
+    for (j = 0; j < n; ++ j)
+    {
+      x[j] /= values_single[self->offsets[j]];
+      for (p = self->offsets[j] + 1; p < self->offsets[j+1]; ++ p)
+        x[self->rows[p]] -= values_single[p]*x[j];
+    }
+    for (j = n - 1; j >= 0; -- j)
+    {
+      for (p = self->offsets[j] + 1; p < self->offsets[j+1]; ++ p)
+        x[j] -= values_single[p]*x[self->rows[p]];
+      x[j] /= values_single[self->offsets[j]];
+    }
+    return;
+  }
+  /* L*y = b */
+  for (j = 0; j < n; ++ j)
+  {
+    x[j] /= values[self->offsets[j]];
+    for (p = self->offsets[j] + 1; p < self->offsets[j+1]; ++ p)
+      x[self->rows[p]] -= values[p]*x[j];
+  }
+  /* L'*x = y */
+  for (j = n - 1; j >= 0; -- j)
+  {
+    for (p = self->offsets[j] + 1; p < self->offsets[j+1]; ++ p)
+      x[j] -= values[p]*x[self->rows[p]];
+    x[j] /= values[self->offsets[j]];
+  }
+}
+
+BOOL slae_cholesky_refine(slae_cholesky_ptr self,
+                          slae_operator_t A,
+                          void* data,
+                          real* b,
+                          real* x,
+                          int* max_iter,
+                          real* tolerance)
+{
+  int n = self->size;
+  int i,iter;
+  real bnorm,rnorm,rnorm_prev;
+  BOOL converged;
+  /* residual and the last correction of the solution */
+  real* r = (real*)malloc(sizeof(real)*n);
+  real* dx = (real*)malloc(sizeof(real)*n);
+
+  bnorm = vector_norm(b,n);
+  if (bnorm == 0)
+    bnorm = 1;
+  slae_cholesky_solve(self,b,x);
+  rnorm_prev = 0;
+  for (iter = 0; ; ++ iter)
+  {
+    /* r = b - A*x in precision of real */
+    A(data,x,r);
+    for (i = 0; i < n; ++ i)
+      r[i] = b[i] - r[i];
+    rnorm = vector_norm(r,n);
+    /* the last correction made the solution worse: take it back */
+    if (iter > 0 && !(rnorm <= rnorm_prev))
+    {
+      for (i = 0; i < n; ++ i)
+        x[i] -= dx[i];
+      rnorm = rnorm_prev;
+      break;
+    }
+    if (rnorm/bnorm <= *tolerance || iter == *max_iter ||
+        (iter > 0 && rnorm > rnorm_prev/2))
+      break;
+    rnorm_prev = rnorm;
+    slae_cholesky_solve(self,r,dx);
+    for (i = 0; i < n; ++ i)
+      x[i] += dx[i];
+  }
+  converged = rnorm/bnorm <= *tolerance;
+  *max_iter = iter;
+  *tolerance = rnorm/bnorm;
+  free(r);
+  free(dx);
+  return converged;
+}
+
+void slae_cholesky_free(slae_cholesky_ptr self)
+{
+  free(self->parent);
+  free(self->offsets);
+  free(self->rows);
+  free(self->values);
+  free(self->values_single);
+  free(self->work);
+  free(self->x);
+  memset(self,0,sizeof(slae_cholesky));
+}
@@ -0,0 +1,358 @@
+/* -*- Mode: C; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+#ifndef __SLAE_SOLVERS_H__
+#define __SLAE_SOLVERS_H__
+
+#include "defines.h"
+#include "sp_matrix.h"
+
+/*************************************************************/
+/* Type declarations                                         */
+
+/*
+ * Sparse Cholesky decomposition A = L*L' of the symmetric positive
+ * definite matrix.
+ * L is stored in CCS format with the diagonal element first in every
+ * column. The pattern of L is created once by symbolic decomposition,
+ * numeric decomposition could be repeated for the matrices with the
+ * same pattern.
+ * Values of L could be stored in single precision, halving memory
+ * and bandwidth of the decomposition and solution; the accuracy of
+ * the solution is recovered by iterative refinement, see
+ * slae_cholesky_refine
+ */
+typedef struct {
+  int size;                     /* size of the matrix */
+  int* parent;                  /* elimination tree, -1 for roots */
+  int* offsets;                 /* offsets of columns of L in rows and
+                                 * values arrays, size+1 */
+  int* rows;                    /* row indexes of L */
+  real* values;                 /* values of L, or 0 if single */
+  float* values_single;         /* values of L in single precision,
+                                 * or 0 if not single */
+  BOOL factorized;              /* numeric decomposition is done */
+  int* work;                    /* integer workspace, 3 x size */
+  real* x;                      /* real workspace, size */
+} slae_cholesky;
+typedef slae_cholesky* slae_cholesky_ptr;
+
+/*
+ * Matrix in CCS format with constrained d.o.f. masked out:
+ * off-diagonal elements in the rows and columns of constrained d.o.f.
+ * are treated as zeros, diagonal elements are kept.
+ * Used to apply boundary conditions without changing the matrix
+ */
+typedef struct {
+  sp_matrix_ptr mtx;            /* matrix itself */
+  BOOL symmetric;               /* only upper triangle is stored */
+  BOOL* mask;                   /* TRUE for constrained d.o.f, or 0 */
+  real* work;                   /* workspace of the size of matrix,
+                                 * required if mask is set */
+} slae_masked_matrix;
+typedef slae_masked_matrix* slae_masked_matrix_ptr;
+
+/* Jacobi preconditioner M = diag(A) */
+typedef struct {
+  int size;                     /* size of the matrix */
+  real* diag;                   /* diagonal of the matrix */
+} slae_jacobi;
+typedef slae_jacobi* slae_jacobi_ptr;
+
+/*
+ * Block Jacobi preconditioner M = blockdiag(A) with the diagonal
+ * blocks of size block, i.e. d.o.f. of one node.
+ * Inverses of blocks are stored one after another, row by row
+ */
+typedef struct {
+  int size;                     /* size of the matrix */
+  int block;                    /* size of the block */
+  real* inverses;               /* inverses of the diagonal blocks,
+                                 * size*block */
+} slae_block_jacobi;
+typedef slae_block_jacobi* slae_block_jacobi_ptr;
+
+/*
+ * Incomplete Cholesky decomposition IC(0) A ~ U'*U, where U has the
+ * pattern of the upper triangle of A, i.e. no fill-in is allowed.
+ * U is stored in CCS format with the diagonal element last in every
+ * column. The pattern is copied once by slae_ic0_symbolic, numeric
+ * decomposition could be repeated for the matrices with the same
+ * pattern
+ */
+typedef struct {
+  int size;                     /* size of the matrix */
+  int* offsets;                 /* offsets of columns of U in rows and
+                                 * values arrays, size+1 */
+  int* rows;                    /* row indexes of U */
+  real* values;                 /* values of U */
+  real shift;                   /* relative diagonal shift used to
+                                 * avoid breakdown of decomposition */
+  BOOL factorized;              /* numeric decomposition is done */
+  real* x;                      /* real workspace, size */
+} slae_ic0;
+typedef slae_ic0* slae_ic0_ptr;
+
+/* maximum number of nonzeros in a row of the prolongation */
+#define SLAE_TWOGRID_PROLONG 2
+
+/*
+ * Two-level multigrid preconditioner. The coarse level is defined by
+ * the prolongation P from the coarse to the fine level, with at most
+ * SLAE_TWOGRID_PROLONG nonzeros in every row. The coarse matrix is
+ * A_c = P'*A*P, solved by the Cholesky decomposition; the smoother is
+ * damped block Jacobi. One application is a symmetric cycle:
+ * pre-smoothing, coarse correction and post-smoothing.
+ * Coarse d.o.f. with empty columns of P are masked out
+ */
+typedef struct {
+  slae_masked_matrix A;         /* fine level matrix, with own work */
+  int size;                     /* size of the fine level */
+  int coarse_size;              /* size of the coarse level */
+  int* prolong_indexes;         /* columns of P in every row, -1 for
+                                 * unused, size*SLAE_TWOGRID_PROLONG */
+  real* prolong_weights;        /* values of P in the same layout */
+  sp_matrix coarse;             /* upper triangle of the coarse matrix */
+  int* coarse_slots;            /* positions in the columns of coarse of
+                                 * the contributions of the fine matrix
+                                 * elements: element k of the fine
+                                 * matrix, k counted over all columns,
+                                 * and prolongation entries p,q of its
+                                 * row and column add to the position
+                                 * [(k*PROLONG + p)*PROLONG + q],
+                                 * -1 for no contribution */
+  int* coarse_diag;             /* positions of the diagonal elements
+                                 * in the columns of coarse */
+  BOOL* coarse_mask;            /* TRUE for masked coarse d.o.f. */
+  slae_cholesky coarse_chol;    /* decomposition of the coarse matrix */
+  slae_block_jacobi smoother;   /* block Jacobi of the fine matrix */
+  int block;                    /* size of the blocks of the smoother */
+  real omega;                   /* damping of the smoother */
+  BOOL factorized;              /* coarse level and smoother are created */
+  real* work;                   /* real workspace,
+                                 * 2*size + coarse_size */
+} slae_twogrid;
+typedef slae_twogrid* slae_twogrid_ptr;
+
+
+/*************************************************************/
+/* Function pointers declarations                            */
+
+/*
+ * A pointer to the function calculating y = A*x for the linear
+ * operator A of the SLAE. data is an operator-specific argument
+ */
+typedef void (*slae_operator_t)(void* data, real* x, real* y);
+
+
+/*************************************************************/
+/* Operations on sparse matrices                             */
+
+/*
+ * Matrix-vector multiplication y = A*x for the symmetric matrix
+ * in CCS format with only upper triangle stored
+ */
+void slae_sym_mv(sp_matrix_ptr mtx, real* x, real* y);
+
+/*
+ * Matrix-vector multiplication y = A*x for the matrix
+ * in CCS format with all elements stored
+ */
+void slae_mv(sp_matrix_ptr mtx, real* x, real* y);
+
+/* Operator wrappers for the functions above, data is sp_matrix_ptr */
+void slae_sym_mv_operator(void* data, real* x, real* y);
+void slae_mv_operator(void* data, real* x, real* y);
+
+/* Matrix-vector multiplication y = A*x for the masked matrix */
+void slae_masked_mv(slae_masked_matrix_ptr A, real* x, real* y);
+
+/* Operator wrapper for slae_masked_mv, data is slae_masked_matrix_ptr */
+void slae_masked_mv_operator(void* data, real* x, real* y);
+
+
+/*************************************************************/
+/* Preconditioners                                           */
+
+/*
+ * Preconditioner operator y = M^-1*x for the Jacobi preconditioner,
+ * data is slae_jacobi_ptr
+ */
+void slae_jacobi_operator(void* data, real* x, real* y);
+
+/*
+ * Create block Jacobi preconditioner for the matrix in CCS format,
+ * with either full or symmetric storage. If mask is not 0, the matrix
+ * is treated as masked, see slae_masked_matrix
+ */
+void slae_block_jacobi_create(slae_block_jacobi_ptr self,
+                              sp_matrix_ptr mtx,
+                              BOOL* mask,
+                              int block);
+
+/*
+ * Preconditioner operator y = M^-1*x for the block Jacobi
+ * preconditioner, data is slae_block_jacobi_ptr
+ */
+void slae_block_jacobi_operator(void* data, real* x, real* y);
+
+/* Free block Jacobi preconditioner data */
+void slae_block_jacobi_free(slae_block_jacobi_ptr self);
+
+/*
+ * Symbolic IC(0) decomposition: copies the pattern of the upper
+ * triangle of the matrix in CCS format with sorted row indexes,
+ * either with full or symmetric storage
+ */
+void slae_ic0_symbolic(slae_ic0_ptr self, sp_matrix_ptr mtx);
+
+/*
+ * Numeric IC(0) decomposition of the matrix with the same pattern as
+ * used in slae_ic0_symbolic. If mask is not 0, the matrix is
+ * decomposed as masked, see slae_masked_matrix.
+ * If the decomposition breaks down, it is repeated with the diagonal
+ * of the matrix increased by the growing relative shift.
+ * Returns FALSE if no shift helped
+ */
+BOOL slae_ic0_numeric(slae_ic0_ptr self, sp_matrix_ptr mtx, BOOL* mask);
+
+/*
+ * Preconditioner operator y = M^-1*x = U^-1*U'^-1*x for IC(0),
+ * data is slae_ic0_ptr
+ */
+void slae_ic0_operator(void* data, real* x, real* y);
+
+/* Free IC(0) decomposition data */
+void slae_ic0_free(slae_ic0_ptr self);
+
+/*
+ * Initialize two-level preconditioner for the masked matrix A, which
+ * shall stay valid, with the prolongation P given by prolong_indexes
+ * and prolong_weights; these arrays are owned by the preconditioner
+ * after the call. block and omega are the size of blocks and damping
+ * of the block Jacobi smoother. The pattern of the coarse matrix is
+ * created from the pattern and mask of A, which shall not change
+ */
+void slae_twogrid_init(slae_twogrid_ptr self,
+                       slae_masked_matrix_ptr A,
+                       int coarse_size,
+                       int* prolong_indexes,
+                       real* prolong_weights,
+                       int block,
+                       real omega);
+
+/*
+ * Create the coarse matrix and its decomposition, and the smoother
+ * from the current values of the fine matrix.
+ * Returns FALSE if the coarse matrix is not positive definite
+ */
+BOOL slae_twogrid_numeric(slae_twogrid_ptr self);
+
+/*
+ * Preconditioner operator y = M^-1*x for the two-level preconditioner,
+ * data is slae_twogrid_ptr
+ */
+void slae_twogrid_operator(void* data, real* x, real* y);
+
+/* Free two-level preconditioner data */
+void slae_twogrid_free(slae_twogrid_ptr self);
+
+
+/*************************************************************/
+/* Iterative solvers                                         */
+
+/*
+ * Solve SLAE A*x = b with the Conjugate Gradient method
+ * A - symmetric positive definite operator
+ * size - size of the SLAE
+ * x - solution, used as an initial guess on input
+ * max_iter - on input maximum number of iterations, on output
+ * number of iterations performed
+ * tolerance - on input desired relative residual |b-Ax|/|b|,
+ * on output achieved relative residual
+ * Returns FALSE if the desired tolerance wasn't reached
+ */
+BOOL slae_solve_cg(slae_operator_t A,
+                   void* data,
+                   int size,
+                   real* b,
+                   real* x,
+                   int* max_iter,
+                   real* tolerance);
+
+/*
+ * Solve SLAE A*x = b with the Preconditioned Conjugate Gradient method
+ * M - symmetric positive definite preconditioner operator calculating
+ * y = M^-1*x, with the argument mdata, or 0 for no preconditioning.
+ * Other arguments are the same as in slae_solve_cg
+ */
+BOOL slae_solve_pcg(slae_operator_t A,
+                    void* data,
+                    slae_operator_t M,
+                    void* mdata,
+                    int size,
+                    real* b,
+                    real* x,
+                    int* max_iter,
+                    real* tolerance);
+
+
+/*************************************************************/
+/* Direct solvers                                            */
+
+/*
+ * Symbolic Cholesky decomposition: builds elimination tree and pattern
+ * of L for the matrix in CCS format. Only upper triangle of the matrix
+ * is used, so the matrix could have either full or symmetric storage
+ */
+void slae_cholesky_symbolic(slae_cholesky_ptr self, sp_matrix_ptr mtx);
+
+/*
+ * Numeric Cholesky decomposition of the matrix with the same pattern
+ * as used in slae_cholesky_symbolic. If mask is not 0, the matrix is
+ * decomposed as masked, see slae_masked_matrix
+ * Returns FALSE if the matrix is not positive definite
+ */
+BOOL slae_cholesky_numeric(slae_cholesky_ptr self,
+                           sp_matrix_ptr mtx,
+                           BOOL* mask);
+
+/*
+ * Select the precision of values of L after the symbolic
+ * decomposition. Numeric decomposition shall be repeated after the
+ * precision is changed. Initially values are in precision of real
+ */
+void slae_cholesky_single(slae_cholesky_ptr self, BOOL single);
+
+/*
+ * Solve A*x = b using numeric decomposition of A.
+ * x and b could be the same vector
+ */
+void slae_cholesky_solve(slae_cholesky_ptr self, real* b, real* x);
+
+/*
+ * Solve A*x = b by iterative refinement of the solution with
+ * inexact (i.e. single precision) decomposition of A:
+ * x = x + L'^-1*L^-1*(b - A*x), with the residual b - A*x calculated
+ * in precision of real by the operator A.
+ * Refinement stops when the relative residual |b-Ax|/|b| reaches the
+ * tolerance or stagnates, i.e. is reduced less than twice per iteration.
+ * If the last correction increases the residual, it is taken back, so
+ * x is the iterate with the smallest residual
+ * x - solution, b and x shall be different vectors
+ * max_iter - on input maximum number of refinement iterations,
+ * on output number of iterations performed
+ * tolerance - on input desired relative residual, on output achieved
+ * relative residual
+ * Returns FALSE if the desired tolerance wasn't reached
+ */
+BOOL slae_cholesky_refine(slae_cholesky_ptr self,
+                          slae_operator_t A,
+                          void* data,
+                          real* b,
+                          real* x,
+                          int* max_iter,
+                          real* tolerance);
+
+/* Free Cholesky decomposition data */
+void slae_cholesky_free(slae_cholesky_ptr self);
+
+#endif /* __SLAE_SOLVERS_H__ */
@@ -8,6 +8,11 @@
 #include "defines.h"
 #include "tests.h"
 #include "dense_matrix.h"
+#include "slae_solvers.h"
+#include "fea_model.h"
+#include "fea_solver.h"
+#include "graph_ordering.h"
+#include "element_batch.h"
 
 static BOOL test_dense_matrix()
 {
@@ -50,7 +55,717 @@ static BOOL test_dense_matrix()
   return result;
 }
 
+static BOOL test_slae_sym_cg()
+{
+  BOOL result = TRUE;
+  int i,j,iter = 10;
+  real tolerance = 1e-14;
+  /* symmetric positive definite matrix */
+  real A[3][3] = {{4, 1, 0}, {1, 3, 1}, {0, 1, 2}};
+  real expected[3] = {1, 2, 3};
+  real b[3] = {6, 10, 8};
+  real x[3] = {0, 0, 0};
+  real y[3];
+  sp_matrix full,upper;
+  sp_matrix_init(&full,3,3,3,CCS);
+  sp_matrix_init(&upper,3,3,3,CCS);
+  for (i = 0; i < 3; ++ i)
+    for (j = 0; j < 3; ++ j)
+      if (A[i][j] != 0)
+      {
+        sp_matrix_element_add(&full,i,j,A[i][j]);
+        if (i <= j)
+          sp_matrix_element_add(&upper,i,j,A[i][j]);
+      }
+  /* multiplication using only upper triangle */
+  slae_sym_mv(&upper,expected,y);
+  for (i = 0; i < 3; ++ i)
+    result &= EQUAL(y[i],b[i]);
+  slae_mv(&full,expected,y);
+  for (i = 0; i < 3; ++ i)
+    result &= EQUAL(y[i],b[i]);
+  /* CG shall converge in at most 3 iterations */
+  if (result)
+  {
+    result = slae_solve_cg(slae_sym_mv_operator,&upper,3,b,x,&iter,&tolerance);
+    for (i = 0; i < 3; ++ i)
+      result &= fabs(x[i] - expected[i]) < 1e-12;
+  }
+  sp_matrix_free(&full);
+  sp_matrix_free(&upper);
+  printf("test_slae_sym_cg result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_slae_preconditioners()
+{
+  BOOL result = TRUE;
+  int i,j,k,iter;
+  real tolerance;
+  /* tridiagonal matrix, IC(0) has no dropped fill-in */
+  real A[3][3] = {{4, 1, 0}, {1, 3, 1}, {0, 1, 2}};
+  real expected[3] = {1, 2, 3};
+  real b[3] = {6, 10, 8};
+  real x[3];
+  sp_matrix upper;
+  slae_masked_matrix masked;
+  slae_block_jacobi jacobi;
+  slae_ic0 ic0;
+  slae_twogrid twogrid;
+  int* prolong_indexes = (int*)malloc(sizeof(int)*3*SLAE_TWOGRID_PROLONG);
+  real* prolong_weights = (real*)malloc(sizeof(real)*3*SLAE_TWOGRID_PROLONG);
+  slae_operator_t M[3] = {slae_block_jacobi_operator, slae_ic0_operator,
+                          slae_twogrid_operator};
+  void* mdata[3];
+  sp_matrix_init(&upper,3,3,3,CCS);
+  for (i = 0; i < 3; ++ i)
+    for (j = i; j < 3; ++ j)
+      if (A[i][j] != 0)
+        sp_matrix_element_add(&upper,i,j,A[i][j]);
+  /* the only block is the whole matrix */
+  slae_block_jacobi_create(&jacobi,&upper,0,3);
+  slae_ic0_symbolic(&ic0,&upper);
+  result = slae_ic0_numeric(&ic0,&upper,0) && ic0.shift == 0;
+  /* two levels with the identity prolongation */
+  for (i = 0; i < 3; ++ i)
+  {
+    prolong_indexes[i*SLAE_TWOGRID_PROLONG] = i;
+    prolong_weights[i*SLAE_TWOGRID_PROLONG] = 1;
+    for (j = 1; j < SLAE_TWOGRID_PROLONG; ++ j)
+      prolong_indexes[i*SLAE_TWOGRID_PROLONG + j] = -1;
+  }
+  masked.mtx = &upper;
+  masked.symmetric = TRUE;
+  masked.mask = 0;
+  slae_twogrid_init(&twogrid,&masked,3,prolong_indexes,prolong_weights,
+                    1,0.5);
+  result &= slae_twogrid_numeric(&twogrid);
+  mdata[0] = &jacobi;
+  mdata[1] = &ic0;
+  mdata[2] = &twogrid;
+  /* all preconditioners are exact, PCG converges in 1 iteration */
+  for (k = 0; k < 3 && result; ++ k)
+  {
+    memset(x,0,sizeof(x));
+    iter = 10;
+    tolerance = 1e-14;
+    result = slae_solve_pcg(slae_sym_mv_operator,&upper,M[k],mdata[k],
+                            3,b,x,&iter,&tolerance) && iter == 1;
+    for (i = 0; i < 3; ++ i)
+      result &= fabs(x[i] - expected[i]) < 1e-12;
+  }
+  slae_block_jacobi_free(&jacobi);
+  slae_ic0_free(&ic0);
+  slae_twogrid_free(&twogrid);
+  sp_matrix_free(&upper);
+  printf("test_slae_preconditioners result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+/* y = 3*A*x, data is sp_matrix_ptr */
+static void test_tripled_mv_operator(void* data, real* x, real* y)
+{
+  sp_matrix_ptr mtx = (sp_matrix_ptr)data;
+  int i;
+  slae_mv(mtx,x,y);
+  for (i = 0; i < mtx->rows_count; ++ i)
+    y[i] *= 3;
+}
+
+static BOOL test_slae_cholesky()
+{
+  BOOL result = TRUE;
+  int i,j,iter;
+  real tolerance;
+  /* symmetric positive definite matrix with fill-in in L */
+  real A[4][4] = {{4, 1, 0, 1}, {1, 3, 0, 0}, {0, 0, 2, 1}, {1, 0, 1, 5}};
+  real expected[4] = {1, 2, 3, 4};
+  real b[4] = {10, 7, 10, 24};
+  real x[4];
+  BOOL mask[4] = {FALSE, FALSE, TRUE, FALSE};
+  sp_matrix full;
+  slae_masked_matrix masked;
+  slae_cholesky chol;
+  sp_matrix_init(&full,4,4,4,CCS);
+  for (i = 0; i < 4; ++ i)
+    for (j = 0; j < 4; ++ j)
+      if (A[i][j] != 0)
+        sp_matrix_element_add(&full,i,j,A[i][j]);
+  slae_cholesky_symbolic(&chol,&full);
+  /* L(3,1) is a fill-in element */
+  result = chol.offsets[4] == 8;
+  /* decomposition shall be reusable for several right-hand sides */
+  result &= slae_cholesky_numeric(&chol,&full,0);
+  for (i = 0; i < 2 && result; ++ i)
+  {
+    slae_cholesky_solve(&chol,b,x);
+    for (j = 0; j < 4; ++ j)
+      result &= fabs(x[j] - expected[j]) < 1e-12;
+  }
+  /* boundary condition on d.o.f. 2 */
+  if (result)
+  {
+    masked.mtx = &full;
+    masked.symmetric = FALSE;
+    masked.mask = mask;
+    masked.work = x;
+    slae_masked_mv(&masked,expected,b);
+    /* row 2 shall contain only diagonal element */
+    result = EQUAL(b[2],6.0) && EQUAL(b[3],21.0);
+    result &= slae_cholesky_numeric(&chol,&full,mask);
+    slae_cholesky_solve(&chol,b,x);
+    for (j = 0; j < 4; ++ j)
+      result &= fabs(x[j] - expected[j]) < 1e-12;
+  }
+  /* single precision decomposition with iterative refinement */
+  if (result)
+  {
+    slae_cholesky_single(&chol,TRUE);
+    result = chol.values_single && !chol.values &&
+      slae_cholesky_numeric(&chol,&full,0);
+    slae_mv(&full,expected,b);
+    iter = MAX_REFINEMENT_ITERATIONS;
+    tolerance = 1e-14;
+    result &= slae_cholesky_refine(&chol,slae_mv_operator,&full,b,x,
+                                   &iter,&tolerance) && iter > 0;
+    for (j = 0; j < 4; ++ j)
+      result &= fabs(x[j] - expected[j]) < 1e-12;
+    /*
+     * refinement diverges with the decomposition of A for 3*A:
+     * the first correction doubles the residual and is taken back
+     */
+    iter = MAX_REFINEMENT_ITERATIONS;
+    tolerance = 1e-14;
+    result &= !slae_cholesky_refine(&chol,test_tripled_mv_operator,&full,
+                                    b,x,&iter,&tolerance) && iter == 1;
+    result &= fabs(tolerance - 2) < 1e-5;
+    for (j = 0; j < 4; ++ j)
+      result &= fabs(x[j] - expected[j]) < 1e-5;
+  }
+  slae_cholesky_free(&chol);
+  sp_matrix_free(&full);
+  printf("test_slae_cholesky result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_graph_ordering()
+{
+  BOOL result = TRUE;
+  /* path 0-3-1-4-2 numbered randomly */
+  int path_offsets[6] = {0, 1, 3, 4, 6, 8};
+  int path_adjacency[8] = {3, 3, 4, 4, 0, 1, 1, 2};
+  /* star with the center 0 and 4 leaves */
+  int star_offsets[6] = {0, 4, 5, 6, 7, 8};
+  int star_adjacency[8] = {1, 2, 3, 4, 0, 0, 0, 0};
+  int perm[5];
+  int i,check = 0;
+  graph_ordering_rcm(5,path_offsets,path_adjacency,perm);
+  for (i = 0; i < 5; ++ i)
+    check += perm[i];
+  result = check == 10 &&
+    graph_bandwidth(5,path_offsets,path_adjacency,0) == 3 &&
+    graph_bandwidth(5,path_offsets,path_adjacency,perm) == 1;
+  /* center eliminated first fills the whole matrix, last - nothing */
+  graph_ordering_amd(5,star_offsets,star_adjacency,perm);
+  result &= graph_cholesky_fill(5,star_offsets,star_adjacency,0) == 15 &&
+    graph_cholesky_fill(5,star_offsets,star_adjacency,perm) == 9;
+  printf("test_graph_ordering result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_model_tangent()
+{
+  BOOL result = TRUE;
+  model_type types[2] = {MODEL_A5, MODEL_COMPRESSIBLE_NEOHOOKEAN};
+  real F[3][3] = {{1.1, 0.2, 0.05}, {-0.1, 0.95, 0.1}, {0.03, 0.07, 1.2}};
+  real closed[VOIGT_SIZE][VOIGT_SIZE];
+  real full[VOIGT_SIZE][VOIGT_SIZE];
+  int t,I,J;
+  fea_model model;
+  model.parameters_count = 2;
+  model.parameters[0] = 100;
+  model.parameters[1] = 80;
+  for (t = 0; t < 2; ++ t)
+  {
+    model.model = types[t];
+    fea_model_init(&model,model.model);
+    /* closed form against the symmetrized full C tensor */
+    fea_model_voigt_tangent(&model,F,closed);
+    model.tangent = 0;
+    fea_model_voigt_tangent(&model,F,full);
+    for (I = 0; I < VOIGT_SIZE; ++ I)
+      for (J = 0; J < VOIGT_SIZE; ++ J)
+        result &= fabs(closed[I][J] - full[I][J]) < 1e-10;
+  }
+  printf("test_model_tangent result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+/*
+ * solver for count TETRAHEDRA10 elements in local coordinates,
+ * translated by 2 along x one after another. Elements have no
+ * common nodes, except the last one of several elements, which
+ * reuses the nodes of the first one
+ */
+static fea_solver_ptr test_tetrahedra10_mesh_solver(int count)
+{
+  real coords[10][3] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1},
+                        {0.5, 0, 0}, {0.5, 0.5, 0}, {0, 0.5, 0},
+                        {0, 0, 0.5}, {0.5, 0, 0.5}, {0, 0.5, 0.5}};
+  fea_task_ptr task = fea_task_alloc();
+  fea_solution_params_ptr params = fea_solution_params_alloc();
+  nodes_array_ptr nodes = nodes_array_alloc();
+  elements_array_ptr elements = elements_array_alloc();
+  presc_bnd_array_ptr presc = presc_bnd_array_alloc();
+  fea_solver_ptr solver;
+  int e,i,j;
+  int disjoint = count > 1 ? count - 1 : 1;
+
+  nodes_array_storage_alloc(nodes,10*disjoint);
+  for (e = 0; e < disjoint; ++ e)
+    for (i = 0; i < 10; ++ i)
+      for (j = 0; j < 3; ++ j)
+        nodes->nodes[e*10 + i][j] = coords[i][j] + (j == 0 ? 2*e : 0);
+  elements->elements_count = count;
+  elements->elements = (int**)malloc(sizeof(int*)*count);
+  for (e = 0; e < count; ++ e)
+  {
+    elements->elements[e] = (int*)malloc(sizeof(int)*10);
+    for (i = 0; i < 10; ++ i)
+      elements->elements[e][i] = (e < disjoint ? e*10 : 0) + i;
+  }
+  
+  solver = fea_solver_alloc(task,params,nodes,elements,presc);
+  solver_create_element_database(solver);
+  solver_create_initial_shape_gradients(solver);
+  return solver;
+}
+
+/* solver for the single TETRAHEDRA10 element in local coordinates */
+static fea_solver_ptr test_tetrahedra10_solver()
+{
+  return test_tetrahedra10_mesh_solver(1);
+}
+
+/* deformation gradients of the test element */
+static real test_shear[MAX_DOF][MAX_DOF] = {{1, 0.1, 0}, {0, 1, 0}, {0, 0, 1}};
+static real test_stretch[MAX_DOF][MAX_DOF] = {{1.1, 0, 0}, {0, 1.1, 0},
+                                              {0, 0, 1.1}};
+
+/*
+ * solver for the single TETRAHEDRA10 element deformed homogeneously
+ * by the deformation gradient F, with the first node fixed, and its
+ * shape gradients, stresses and residual forces
+ */
+static fea_solver_ptr
+test_tetrahedra10_deformed_solver(real F[MAX_DOF][MAX_DOF])
+{
+  fea_solver_ptr solver = test_tetrahedra10_solver();
+  real x[MAX_DOF];
+  int i,j,k;
+
+  for (i = 0; i < 10; ++ i)
+  {
+    memcpy(x,solver->nodes_p->nodes[i],sizeof(x));
+    for (j = 0; j < MAX_DOF; ++ j)
+    {
+      solver->nodes_p->nodes[i][j] = 0;
+      for (k = 0; k < MAX_DOF; ++ k)
+        solver->nodes_p->nodes[i][j] += F[j][k]*x[k];
+    }
+  }
+  for (i = 0; i < MAX_DOF; ++ i)
+    solver->bc_mask[solver_global_dof(solver,0,i)] = TRUE;
+  solver_create_element_colors(solver);
+  solver_create_current_shape_gradients(solver);
+  solver_create_stresses_and_residual_forces(solver);
+  return solver;
+}
+
+static BOOL test_shape_gradients_update()
+{
+  BOOL result = TRUE;
+  fea_solver_ptr solver = test_tetrahedra10_solver();
+  real* grads;
+  real* detJ;
+  int i,j,size,allocations;
+
+  /* solver arrays are counted */
+  result = solver_aligned_allocations_count() > 0;
+  solver_create_current_shape_gradients(solver);
+  grads = solver->shape_gradients;
+  detJ = solver->detJ;
+  /* stretch element twice and update gradients */
+  for (i = 0; i < 10; ++ i)
+    for (j = 0; j < MAX_DOF; ++ j)
+      solver->nodes_p->nodes[i][j] *= 2;
+  allocations = solver_aligned_allocations_count();
+  solver_create_current_shape_gradients(solver);
+  /* gradients shall be updated in the same storage, with no allocations */
+  result &= grads == solver->shape_gradients && detJ == solver->detJ;
+  result &= solver_aligned_allocations_count() == allocations;
+  size = solver->fea_params_p->gauss_nodes_count*
+    solver->fea_params_p->nodes_per_element*solver->task_p->dof;
+  for (i = 0; i < solver->fea_params_p->gauss_nodes_count; ++ i)
+    result &= fabs(solver->detJ[i] - 8*solver->detJ0[i]) < 1e-12;
+  for (i = 0; i < size; ++ i)
+    result &= fabs(2*solver->shape_gradients[i] -
+                   solver->shape_gradients0[i]) < 1e-12;
+  fea_solver_free(solver);
+  printf("test_shape_gradients_update result: *%s*\n",
+         result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_fused_residual_forces()
+{
+  BOOL result = TRUE;
+  fea_solver_ptr solver = test_tetrahedra10_deformed_solver(test_shear);
+  real forces[MAX_ELEMENT_DOF];
+  int i,size = solver->global_mtx.rows_count;
+
+  /* two-pass calculation as a reference */
+  solver_create_stresses(solver);
+  solver_create_residual_forces(solver);
+  memcpy(forces,solver->global_forces_vct,sizeof(real)*size);
+  /* sheared element is not in equilibrium */
+  result = cdot(forces,forces,size) > 1e-6;
+  memset(solver->stresses,0,
+         sizeof(tensor)*solver->fea_params_p->gauss_nodes_count);
+  solver_create_stresses_and_residual_forces(solver);
+  for (i = 0; i < size; ++ i)
+    result &= fabs(solver->global_forces_vct[i] - forces[i]) < 1e-12;
+  fea_solver_free(solver);
+  printf("test_fused_residual_forces result: *%s*\n",
+         result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_element_batch()
+{
+  BOOL result = TRUE;
+  /*
+   * the first color has a full batch and a partial tail,
+   * the second one is the last element sharing nodes with the first
+   */
+  int count = ELEMENT_BATCH_SIZE + 4;
+  fea_solver_ptr solver = test_tetrahedra10_mesh_solver(count);
+  int i,j,k,size = solver->global_mtx.rows_count;
+  int grads_size = solver->fea_params_p->gauss_nodes_count*
+    solver->fea_params_p->nodes_per_element*solver->task_p->dof*count;
+  real* forces = (real*)malloc(sizeof(real)*size);
+  real* grads = (real*)malloc(sizeof(real)*grads_size);
+  sp_matrix stiffness;
+  /* specialized kernels selected by the solver and generic ones */
+  batch_kernels kernels[2];
+  kernels[0] = solver->kernels;
+  kernels[1] = batch_kernels_generic;
+
+  /* different shear of every element */
+  for (i = 0; i < solver->nodes_p->nodes_count; ++ i)
+    solver->nodes_p->nodes[i][0] +=
+      0.02*(i/10 + 1)*solver->nodes_p->nodes[i][1];
+  solver_create_element_colors(solver);
+  result &= solver->colors_count == 2 &&
+    solver->color_offsets[1] == count - 1;
+  /* element by element kernels as a reference */
+  solver->task_p->element_batch = FALSE;
+  solver_create_current_shape_gradients(solver);
+  memcpy(grads,solver->shape_gradients,sizeof(real)*grads_size);
+  solver_create_stresses_and_residual_forces(solver);
+  memcpy(forces,solver->global_forces_vct,sizeof(real)*size);
+  solver_create_stiffness(solver);
+  sp_matrix_copy(&solver->global_mtx,&stiffness);
+  solver->task_p->element_batch = TRUE;
+  for (k = 0; k < 2; ++ k)
+  {
+    solver->kernels = kernels[k];
+    memset(solver->shape_gradients,0,sizeof(real)*grads_size);
+    solver_create_current_shape_gradients(solver);
+    for (i = 0; i < grads_size; ++ i)
+      result &= fabs(solver->shape_gradients[i] - grads[i]) < 1e-12;
+    solver_create_stresses_and_residual_forces(solver);
+    for (i = 0; i < size; ++ i)
+      result &= fabs(solver->global_forces_vct[i] - forces[i]) < 1e-12;
+    solver_create_stiffness(solver);
+    for (i = 0; i < size; ++ i)
+      for (j = 0; j <= stiffness.storage[i].last_index; ++ j)
+        result &= fabs(solver->global_mtx.storage[i].values[j] -
+                       stiffness.storage[i].values[j]) < 1e-10;
+  }
+  sp_matrix_free(&stiffness);
+  free(forces);
+  free(grads);
+  fea_solver_free(solver);
+  printf("test_element_batch result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_stiffness_product()
+{
+  BOOL result = TRUE;
+  fea_solver_ptr solver = test_tetrahedra10_deformed_solver(test_shear);
+  int i,t,size = solver->global_mtx.rows_count;
+  real x[MAX_ELEMENT_DOF];
+  real y[MAX_ELEMENT_DOF];
+  real expected[MAX_ELEMENT_DOF];
+  slae_masked_matrix A;
+  A.mtx = &solver->global_mtx;
+  A.symmetric = solver->task_p->symmetric_storage;
+  A.mask = solver->bc_mask;
+  A.work = y;
+
+  for (i = 0; i < size; ++ i)
+    x[i] = sin(i + 1.0);
+  /* isotropic tangent and the full C tensor */
+  for (t = 0; t < 2; ++ t)
+  {
+    if (t == 1)
+      solver->task_p->model.tangent = 0;
+    solver_create_stiffness(solver);
+    slae_masked_mv(&A,x,expected);
+    solver_create_stiffness_diagonal(solver);
+    solver_stiffness_product(solver,x,y);
+    for (i = 0; i < size; ++ i)
+      result &= fabs(y[i] - expected[i]) < 1e-10;
+  }
+  fea_solver_free(solver);
+  printf("test_stiffness_product result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_predictor()
+{
+  BOOL result = TRUE;
+  fea_solver_ptr solver = test_tetrahedra10_solver();
+  int i,j,step,node,size = solver->global_mtx.rows_count;
+  real x[MAX_ELEMENT_DOF];
+  real expected;
+
+  /* motion proportional to the load by load steps 1 and 2 */
+  for (i = 0; i < MAX_DOF; ++ i)
+    solver->bc_mask[solver_global_dof(solver,0,i)] = TRUE;
+  solver_create_predictor(solver,x);
+  for (i = 0; i < size; ++ i)
+    result &= x[i] == 0;
+  for (step = 1; step <= 2; ++ step)
+  {
+    for (i = 1; i < 10; ++ i)
+      for (j = 0; j < MAX_DOF; ++ j)
+        solver->nodes_p->nodes[i][j] += 0.01*step*(i + j);
+    solver->load += step;
+    solver_load_step_store(solver);
+  }
+  /* the extrapolated increment for the next load step 0.5 */
+  solver->load_increment = 0.5;
+  solver_create_predictor(solver,x);
+  for (i = 0; i < size; ++ i)
+  {
+    node = solver->node_iperm[i/MAX_DOF];
+    expected = node ? 0.005*(node + i%MAX_DOF) : 0;
+    result &= fabs(x[i] - expected) < 1e-14;
+  }
+  fea_solver_free(solver);
+  printf("test_predictor result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_adaptive_load_steps()
+{
+  BOOL result = TRUE;
+  fea_solver_ptr solver = test_tetrahedra10_solver();
+
+  solver->task_p->desired_newton_count = 8;
+  /* fast convergence grows the step by at most LOAD_STEP_GROWTH_MAX */
+  result &= solver_adapt_load_increment(solver,1,2,TRUE) ==
+    LOAD_STEP_GROWTH_MAX;
+  result &= fabs(solver_adapt_load_increment(solver,1,4,TRUE) -
+                 sqrt(2.)) < 1e-15;
+  /* slow convergence keeps it, failure halves it */
+  result &= solver_adapt_load_increment(solver,1,32,TRUE) == 1;
+  result &= solver_adapt_load_increment(solver,1,3,FALSE) == 0.5;
+  fea_solver_free(solver);
+  printf("test_adaptive_load_steps result: *%s*\n",
+         result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_forcing_term()
+{
+  BOOL result = TRUE;
+  fea_solver_ptr solver = test_tetrahedra10_solver();
+  real tolerance = solver->task_p->solver_tolerance;
+
+  solver_update_forcing_term(solver,3,1e-4,1);
+  result &= solver->slae_tolerance == tolerance;
+  solver->task_p->inexact_newton = TRUE;
+  solver->task_p->desired_tolerance = 1e-12;
+  solver_update_forcing_term(solver,1,0,0);
+  result &= solver->slae_tolerance == FORCING_TERM_MAX;
+  /* fast convergence: eta = gamma*1e-4 */
+  solver_update_forcing_term(solver,3,1e-4,1);
+  result &= fabs(solver->slae_tolerance - FORCING_TERM_GAMMA*1e-4) < 1e-15;
+  /* slow convergence */
+  solver_update_forcing_term(solver,4,0.5e-4,1e-4);
+  result &= solver->slae_tolerance == FORCING_TERM_MAX;
+  /* no oversolving near the convergence */
+  solver_update_forcing_term(solver,5,1e-8,1e-4);
+  result &= fabs(solver->slae_tolerance - 0.5e-2) < 1e-15;
+  fea_solver_free(solver);
+  printf("test_forcing_term result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_line_search()
+{
+  BOOL result = TRUE;
+  fea_solver_ptr solver = test_tetrahedra10_deformed_solver(test_stretch);
+  int i,node,size = solver->global_mtx.rows_count;
+  real* x = solver->global_solution_vct;
+  real energy;
+
+  /* direction to the initial configuration, 3 times too long */
+  for (i = 0; i < size; ++ i)
+  {
+    node = solver->node_iperm[i/MAX_DOF];
+    x[i] = solver->bc_mask[i] ? 0 :
+      3*(solver->nodes0_p->nodes[node][i%MAX_DOF] -
+         solver->nodes_p->nodes[node][i%MAX_DOF]);
+  }
+  energy = cdot(solver->global_forces_vct,x,size);
+  result &= energy > 0;
+  solver_update_nodes_with_solution(solver,x);
+  solver_create_current_shape_gradients(solver);
+  solver_create_stresses_and_residual_forces(solver);
+  solver->task_p->linesearch_max = 10;
+  result &= solver_line_search(solver,energy) > 0;
+  /* nodes are moved back close to the initial configuration */
+  result &= fabs(cdot(solver->global_forces_vct,x,size)) <=
+    LINESEARCH_TOLERANCE*energy;
+  for (i = 1; i < 10; ++ i)
+    result &= fabs(solver->nodes_p->nodes[i][0] -
+                   solver->nodes0_p->nodes[i][0]) < 0.05;
+  fea_solver_free(solver);
+  printf("test_line_search result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_arc_length()
+{
+  BOOL result = TRUE;
+  fea_solver_ptr solver;
+  presc_bnd_array_ptr presc;
+  int i,k,cutbacks,nodes[4] = {0, 2, 3, 1};
+  /*
+   * the first run converges in 4 and 7 Newton iterations per step;
+   * the second one allows only 5, so steps are rolled back and the
+   * arc length is cut back, but the final load is still reached
+   */
+  int newton_count[2] = {20, 5};
+  real pull = 0.1;
+
+  for (k = 0; k < 2 && result; ++ k)
+  {
+    solver = test_tetrahedra10_solver();
+    presc = solver->presc_boundary_p;
+    /* fix 3 vertices and pull the last one per load increment */
+    presc->prescribed_nodes_count = 4;
+    presc->prescribed_nodes =
+      (prescribed_bnd_node*)calloc(4,sizeof(prescribed_bnd_node));
+    for (i = 0; i < 4; ++ i)
+    {
+      presc->prescribed_nodes[i].node_number = nodes[i];
+      presc->prescribed_nodes[i].type = PRESCRIBEDXYZ;
+    }
+    presc->prescribed_nodes[3].values[0] = pull;
+    solver_apply_bc_general(solver,solver_mark_single_bc,0);
+    solver->task_p->load_increments_count = 2;
+    solver->task_p->max_newton_count = newton_count[k];
+    solver->task_p->arclength_max = 20;
+    solver_create_element_colors(solver);
+    cutbacks = solver_arc_length(solver);
+    result &= k == 0 ? cutbacks == 0 : cutbacks > 0;
+    result &= solver->load == 2 && solver->current_load_step > 0;
+    result &= fabs(solver->nodes_p->nodes[1][0] - (1 + 2*pull)) < 1e-12;
+    result &= fabs(solver->nodes_p->nodes[2][1] - 1) < 1e-12;
+    fea_solver_free(solver);
+  }
+  printf("test_arc_length result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_bfgs()
+{
+  BOOL result = TRUE;
+  fea_solver_ptr solver = test_tetrahedra10_deformed_solver(test_shear);
+  int i,size = solver->global_mtx.rows_count;
+  real s[MAX_ELEMENT_DOF];
+
+  solver_create_stiffness(solver);
+  solver_bfgs_init(&solver->bfgs,size);
+  /* the first iteration solves with the stiffness matrix */
+  for (i = 0; i < size; ++ i)
+    solver->global_forces_vct[i] = solver->bc_mask[i] ? 0 : sin(i + 1.0);
+  solver_bfgs_solve(solver,TRUE);
+  /* update by the step s with the change of forces y */
+  for (i = 0; i < size; ++ i)
+  {
+    s[i] = solver->bc_mask[i] ? 0 : cos(i + 1.0);
+    solver->global_solution_vct[i] = s[i];
+    solver->global_forces_vct[i] = solver->bc_mask[i] ? 0 :
+      sin(i + 1.0) - 0.5*cos(i + 2.0);
+  }
+  solver_bfgs_update(solver);
+  result &= solver->bfgs.count == 1;
+  /* secant equation: the updated inverse maps y to s */
+  for (i = 0; i < size; ++ i)
+    solver->global_forces_vct[i] = solver->bc_mask[i] ? 0 :
+      0.5*cos(i + 2.0);
+  memset(solver->global_solution_vct,0,sizeof(real)*size);
+  solver_bfgs_solve(solver,FALSE);
+  for (i = 0; i < size; ++ i)
+    result &= fabs(solver->global_solution_vct[i] - s[i]) < 1e-8;
+  fea_solver_free(solver);
+  printf("test_bfgs result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
+static BOOL test_tangent_refresh()
+{
+  BOOL result = TRUE;
+  fea_solver_ptr solver = test_tetrahedra10_solver();
+
+  /* disabled by default */
+  result &= !solver_tangent_refresh_needed(solver,3,0.9,0.8,0);
+  solver->task_p->tangent_refresh_ratio = 0.5;
+  solver->task_p->tangent_refresh_max = 2;
+  /* ratios of the same tangent only */
+  result &= !solver_tangent_refresh_needed(solver,2,0.9,0.8,0);
+  result &= !solver_tangent_refresh_needed(solver,3,0.1,0.05,0);
+  /* slow, but improving contraction */
+  result &= !solver_tangent_refresh_needed(solver,3,0.8,0.9,0);
+  result &= solver_tangent_refresh_needed(solver,3,0.9,0.8,0);
+  result &= solver_tangent_refresh_needed(solver,4,NAN,0.8,1);
+  result &= !solver_tangent_refresh_needed(solver,3,0.9,0.8,2);
+  solver->task_p->modified_newton = FALSE;
+  result &= !solver_tangent_refresh_needed(solver,3,0.9,0.8,0);
+  fea_solver_free(solver);
+  printf("test_tangent_refresh result: *%s*\n",result ? "pass" : "fail");
+  return result;
+}
+
 BOOL do_tests()
 {
-  return test_dense_matrix();
+  return test_dense_matrix() && test_slae_sym_cg() &&
+    test_slae_preconditioners() && test_slae_cholesky() &&
+    test_graph_ordering() && test_model_tangent();
+}
+
+BOOL do_solver_tests()
+{
+  return test_shape_gradients_update() && test_fused_residual_forces() &&
+    test_element_batch() && test_stiffness_product() &&
+    test_predictor() && test_forcing_term() && test_line_search() &&
+    test_adaptive_load_steps() && test_arc_length() && test_bfgs() &&
+    test_tangent_refresh();
 }
@@ -8,4 +8,12 @@
  */
 BOOL do_tests();
 
+/*
+ * Tests of the solver functions on small meshes, including the
+ * nonlinear solution drivers. They create solver instances and
+ * write to the log, so they are run only by the --tests option
+ * returns FALSE if fail
+ */
+BOOL do_solver_tests();
+
 #endif /* __TESTS_H__ */